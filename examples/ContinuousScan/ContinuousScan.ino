@@ -0,0 +1,79 @@
+/**
+ * Example to scan tags continuously and print the events of each one
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "Electroniccats_PN7150.h"
+#define PN7150_IRQ (11)
+#define PN7150_VEN (13)
+#define PN7150_ADDR (0x28)
+
+Electroniccats_PN7150 nfc(PN7150_IRQ, PN7150_VEN, PN7150_ADDR, PN7150); // creates a global NFC device interface object, attached to pins 11 (IRQ) and 13 (VEN) and using the default I2C address 0x28,specify PN7150 or PN7160 in constructor
+
+// Function prototypes
+void printEvent(TagEvent_t* event);
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial)
+    ;
+  Serial.println("Continuous scan with PN7150/60");
+
+  Serial.println("Initializing...");
+  if (nfc.begin()) {
+    Serial.println("Error initializing PN7150");
+    while (1)
+      ;
+  }
+
+  // Read NDEF messages too, tags not seen for 500 ms are removed
+  nfc.startContinuousScan(true, 500);
+  Serial.println("Scanning...");
+}
+
+void loop() {
+  TagEvent_t event;
+
+  nfc.handleContinuousScan();
+
+  while (nfc.getTagEvent(&event)) {
+    printEvent(&event);
+  }
+}
+
+void printEvent(TagEvent_t* event) {
+  switch (event->type) {
+    case TAG_EVENT_UID_SEEN:
+      Serial.print("Seen:      ");
+      break;
+    case TAG_EVENT_ACTIVATED:
+      Serial.print("Activated: ");
+      break;
+    case TAG_EVENT_NDEF_READ:
+      Serial.print("NDEF read: ");
+      break;
+    case TAG_EVENT_REMOVED:
+      Serial.print("Removed:   ");
+      break;
+  }
+
+  for (int i = 0; i < event->uidLen; i++) {
+    if (event->uid[i] <= 0xF)
+      Serial.print("0");
+    Serial.print(event->uid[i], HEX);
+    Serial.print(" ");
+  }
+
+  if (event->type == TAG_EVENT_NDEF_READ) {
+    Serial.print("(");
+    Serial.print(event->ndefSize);
+    Serial.print(" bytes)");
+  }
+  Serial.println();
+}
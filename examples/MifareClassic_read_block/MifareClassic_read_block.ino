@@ -20,6 +20,8 @@
 #define BLK_NB_MFC 4                                // Block tat wants to be read
 #define KEY_MFC 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // Default Mifare Classic key
 
+const unsigned char mfcKey[] = {KEY_MFC};
+
 Electroniccats_PN7150 nfc(PN7150_IRQ, PN7150_VEN, PN7150_ADDR, PN7150); // creates a global NFC device interface object, attached to pins 7 (IRQ) and 8 (VEN) and using the default I2C address 0x28,specify PN7150 or PN7160 in constructor
 
 void PrintBuf(const byte* data, const uint32_t numBytes) {  // Print hex data buffer in format
@@ -42,14 +44,11 @@ void PCD_MIFARE_scenario(void) {
   bool status;
   unsigned char Resp[256];
   unsigned char RespSize;
-  /* Authenticate sector 1 with generic keys */
-  unsigned char Auth[] = {0x40, BLK_NB_MFC / 4, 0x10, KEY_MFC};
   /* Read block 4 */
   unsigned char Read[] = {0x10, 0x30, BLK_NB_MFC};
 
-  /* Authenticate */
-  status = nfc.readerTagCmd(Auth, sizeof(Auth), Resp, &RespSize);
-  if ((status == NFC_ERROR) || (Resp[RespSize - 1] != 0))
+  /* Authenticate sector 1 with the keys of the key ring */
+  if (nfc.mifareAuthenticate(BLK_NB_MFC / 4) == NFC_ERROR)
     Serial.println("Auth error!");
 
   /* Read block */
@@ -88,7 +87,8 @@ void setup() {
     while (1)
       ;
   }
-  nfc.startDiscovery();  // NCI Discovery mode
+  nfc.addMifareKey(mfcKey);  // Key A, tried on every sector
+  nfc.startDiscovery();      // NCI Discovery mode
   Serial.println("Waiting for an Mifare Classic Card...");
 }
 
@@ -21,6 +21,8 @@
 #define BLK_NB_MFC 4                                // Block that wants to be read
 #define KEY_MFC 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // Default Mifare Classic key
 
+const unsigned char mfcKey[] = {KEY_MFC};
+
 // Data to be written in the Mifare Classic block
 #define DATA_WRITE_MFC 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
 
@@ -46,8 +48,6 @@ uint8_t PCD_MIFARE_scenario(void) {
   bool status;
   unsigned char Resp[256];
   unsigned char RespSize;
-  /* Authenticate sector 1 with generic keys */
-  unsigned char Auth[] = {0x40, BLK_NB_MFC / 4, 0x10, KEY_MFC};
   /* Read block 4 */
   unsigned char Read[] = {0x10, 0x30, BLK_NB_MFC};
   /* Write block 4 */
@@ -57,9 +57,8 @@ uint8_t PCD_MIFARE_scenario(void) {
   // Determine ChipWriteAck based on chip model
   uint8_t ChipWriteAck = (nfc.getChipModel() == PN7160) ? 0x14 : 0x00;
 
-  /* Authenticate */
-  status = nfc.readerTagCmd(Auth, sizeof(Auth), Resp, &RespSize);
-  if ((status == NFC_ERROR) || (Resp[RespSize - 1] != 0)) {
+  /* Authenticate sector 1 with the keys of the key ring */
+  if (nfc.mifareAuthenticate(BLK_NB_MFC / 4) == NFC_ERROR) {
     Serial.println("Auth error!");
     return 1;
   }
@@ -129,7 +128,8 @@ void setup() {
     while (1)
       ;
   }
-  nfc.startDiscovery();  // NCI Discovery mode
+  nfc.addMifareKey(mfcKey);  // Key A, tried on every sector
+  nfc.startDiscovery();      // NCI Discovery mode
   Serial.println("Waiting for an Mifare Classic Card...");
 }
 
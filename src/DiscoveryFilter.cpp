@@ -0,0 +1,71 @@
+/**
+ * Library to filter the tags found during the discovery before they reach
+ * the application
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "DiscoveryFilter.h"
+
+DiscoveryFilter::DiscoveryFilter() { this->ruleCount = 0; }
+
+bool DiscoveryFilter::add(const DiscoveryFilterRule_t *rule) {
+  if ((ruleCount >= DISCOVERY_FILTER_MAX_RULES) ||
+      (rule->nfcIdPrefixLen > DISCOVERY_FILTER_MAX_PREFIX_SIZE))
+    return false;
+
+  rules[ruleCount++] = *rule;
+  return true;
+}
+
+void DiscoveryFilter::clear() { this->ruleCount = 0; }
+
+uint8_t DiscoveryFilter::getRuleCount() const { return this->ruleCount; }
+
+bool DiscoveryFilter::matchesRule(const DiscoveryFilterRule_t *rule,
+                                  const RemoteDevice *pTag) const {
+  if ((rule->fields & DISCOVERY_FILTER_PROTOCOL) &&
+      (pTag->getProtocol() != rule->protocol))
+    return false;
+
+  if (rule->fields & DISCOVERY_FILTER_SENS_RES) {
+    if ((pTag->getSensRes() == NULL) || (pTag->getSensResLen() < 2) ||
+        memcmp(pTag->getSensRes(), rule->sensRes, 2))
+      return false;
+  }
+
+  if (rule->fields & DISCOVERY_FILTER_SEL_RES) {
+    if ((pTag->getSelRes() == NULL) || (pTag->getSelResLen() < 1) ||
+        (pTag->getSelRes()[0] != rule->selRes))
+      return false;
+  }
+
+  if (rule->fields & DISCOVERY_FILTER_NFCID) {
+    if ((pTag->getUIDLen() < rule->nfcIdPrefixLen) ||
+        ((rule->nfcIdPrefixLen > 0) &&
+         memcmp(pTag->getUID(), rule->nfcIdPrefix, rule->nfcIdPrefixLen)))
+      return false;
+  }
+
+  return true;
+}
+
+/*
+ * Without rules every tag is accepted, otherwise the tag must match at least
+ * one of them
+ */
+bool DiscoveryFilter::accepts(const RemoteDevice *pTag) const {
+  if (ruleCount == 0)
+    return true;
+
+  for (uint8_t i = 0; i < ruleCount; i++) {
+    if (matchesRule(&rules[i], pTag))
+      return true;
+  }
+  return false;
+}
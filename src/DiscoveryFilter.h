@@ -0,0 +1,56 @@
+/**
+ * Library to filter the tags found during the discovery before they reach
+ * the application
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef DiscoveryFilter_H
+#define DiscoveryFilter_H
+
+#include "Arduino.h"
+#include "RemoteDevice.h"
+
+#ifndef DISCOVERY_FILTER_MAX_RULES
+#define DISCOVERY_FILTER_MAX_RULES 4
+#endif
+#define DISCOVERY_FILTER_MAX_PREFIX_SIZE 10
+
+/*
+ * Fields checked by a rule, a rule matches when all its fields match
+ */
+#define DISCOVERY_FILTER_PROTOCOL (1 << 0)
+#define DISCOVERY_FILTER_SENS_RES (1 << 1) // First 2 bytes of SENS_RES
+#define DISCOVERY_FILTER_SEL_RES (1 << 2)  // NFC-A only
+#define DISCOVERY_FILTER_NFCID (1 << 3)    // Prefix of RemoteDevice::getUID()
+
+typedef struct {
+  uint8_t fields;
+  uint8_t protocol;
+  unsigned char sensRes[2];
+  unsigned char selRes;
+  unsigned char nfcIdPrefix[DISCOVERY_FILTER_MAX_PREFIX_SIZE];
+  uint8_t nfcIdPrefixLen;
+} DiscoveryFilterRule_t;
+
+class DiscoveryFilter {
+private:
+  DiscoveryFilterRule_t rules[DISCOVERY_FILTER_MAX_RULES];
+  uint8_t ruleCount;
+  bool matchesRule(const DiscoveryFilterRule_t *rule,
+                   const RemoteDevice *pTag) const;
+
+public:
+  DiscoveryFilter();
+  bool add(const DiscoveryFilterRule_t *rule);
+  void clear();
+  uint8_t getRuleCount() const;
+  bool accepts(const RemoteDevice *pTag) const;
+};
+
+#endif
@@ -16,6 +16,9 @@
  */
 
 #include "Electroniccats_PN7150.h"
+#include "RW_NDEF_T2T.h"
+#include "RW_NDEF_T3T.h"
+#include "RW_NDEF_T5T.h"
 
 uint8_t gNextTag_Protocol = PROT_UNDETERMINED;
 
@@ -324,8 +327,8 @@ uint8_t Electroniccats_PN7150::ConfigMode(uint8_t modeSE) {
   const uint8_t R_CARDEMU[] = {0x1, 0x3, 0x0, 0x1, 0x4};
 
   // RW Mode
-  const uint8_t DM_RW[] = {0x1, 0x1, 0x1, 0x2, 0x1,  0x1,  0x3, 0x1,
-                           0x1, 0x4, 0x1, 0x2, 0x80, 0x01, 0x80};
+  uint8_t DM_RW[] = {0x1, 0x1, 0x1, 0x2, 0x1,  0x1,  0x3, 0x1,
+                     0x1, 0x4, 0x1, 0x2, 0x80, 0x01, 0x80};
   uint8_t NCIPropAct[] = {0x2F, 0x02, 0x00};
 
   // P2P Support
@@ -365,6 +368,9 @@ uint8_t Electroniccats_PN7150::ConfigMode(uint8_t modeSE) {
     Item++;
   }
   if (mode & MODE_RW and modeSE == 1) {
+    /* UID only: activate ISO-DEP tags on the frame interface to skip RATS */
+    if (uidOnlyMode)
+      DM_RW[11] = INTF_FRAME;
     memcpy(&Command[4 + (3 * Item)], DM_RW, sizeof(DM_RW));
     Item += sizeof(DM_RW) / 3;
   }
@@ -424,6 +430,97 @@ uint8_t Electroniccats_PN7150::ConfigMode(uint8_t modeSE) {
   return SUCCESS;
 }
 
+void Electroniccats_PN7150::countTagDetectorWake() {
+  /* Previous wake up did not end in a tag detection */
+  if (tagDetectorWakePending)
+    tagDetectorStats.falseWakes++;
+
+  tagDetectorStats.wakes++;
+  tagDetectorWakePending = true;
+}
+
+uint8_t Electroniccats_PN7150::writeTagDetectorSettings() {
+  uint8_t NxpNci_CORE_CONF_EXTN[] = {
+      0x20, 0x02, 0x0D, 0x03, /* CORE_SET_CONFIG_CMD */
+      0xA0, 0x40, 0x01, 0x00, /* TAG_DETECTOR_CFG */
+      0xA0, 0x41, 0x01, 0x04, /* TAG_DETECTOR_THRESHOLD_CFG */
+      0xA0, 0x43, 0x01, 0x00  /* TAG_DETECTOR_FALLBACK_CNT_CFG */
+  };
+  uint8_t NxpNci_CORE_CONF_EXTN_3rdGen[] = {
+      0x20, 0x02, 0x05, 0x01, /* CORE_SET_CONFIG_CMD */
+      0xA0, 0x40, 0x01, 0x00  /* TAG_DETECTOR_CFG */
+  };
+  uint8_t NxpNci_CORE_STANDBY[] = {0x2F, 0x00, 0x01, 0x01};
+
+  NxpNci_CORE_CONF_EXTN[7] = tagDetectorCfg;
+  NxpNci_CORE_CONF_EXTN[11] = tagDetectorThreshold;
+  NxpNci_CORE_CONF_EXTN[15] = tagDetectorFallback;
+  NxpNci_CORE_CONF_EXTN_3rdGen[7] = tagDetectorCfg;
+  NxpNci_CORE_STANDBY[3] = standbyEnabled ? 0x01 : 0x00;
+
+  if (_chipModel == PN7150)
+    (void)writeData(NxpNci_CORE_CONF_EXTN, sizeof(NxpNci_CORE_CONF_EXTN));
+  else if (_chipModel == PN7160)
+    (void)writeData(NxpNci_CORE_CONF_EXTN_3rdGen,
+                    sizeof(NxpNci_CORE_CONF_EXTN_3rdGen));
+  getMessage(10);
+  if ((rxBuffer[0] != 0x40) || (rxBuffer[1] != 0x02) || (rxBuffer[3] != 0x00))
+    return ERROR;
+
+  (void)writeData(NxpNci_CORE_STANDBY, sizeof(NxpNci_CORE_STANDBY));
+  getMessage(10);
+  if ((rxBuffer[0] != 0x4F) || (rxBuffer[1] != 0x00) || (rxBuffer[3] != 0x00))
+    return ERROR;
+
+  return SUCCESS;
+}
+
+/*
+ * Settings are stored and applied by configureSettings(), if the device is
+ * already running they are written right away with the discovery stopped
+ */
+bool Electroniccats_PN7150::applyTagDetectorSettings() {
+  bool status;
+
+  if (!_hasBeenInitialized)
+    return true;
+
+  (void)stopDiscovery();
+  status = (writeTagDetectorSettings() == SUCCESS);
+  if (startDiscovery())
+    return false;
+
+  return status;
+}
+
+bool Electroniccats_PN7150::setTagDetector(bool enable, uint8_t threshold,
+                                           uint8_t fallbackCount, bool trace) {
+  tagDetectorCfg = 0x00;
+  if (enable)
+    tagDetectorCfg |= TAG_DETECTOR_ENABLE;
+  if (trace)
+    tagDetectorCfg |= TAG_DETECTOR_TRACE;
+  tagDetectorThreshold = threshold;
+  tagDetectorFallback = fallbackCount;
+  tagDetectorWakePending = false;
+
+  return applyTagDetectorSettings();
+}
+
+bool Electroniccats_PN7150::setStandby(bool enable) {
+  standbyEnabled = enable;
+  return applyTagDetectorSettings();
+}
+
+const TagDetectorStats_t *Electroniccats_PN7150::getTagDetectorStats() const {
+  return &tagDetectorStats;
+}
+
+void Electroniccats_PN7150::clearTagDetectorStats() {
+  memset(&tagDetectorStats, 0, sizeof(tagDetectorStats));
+  tagDetectorWakePending = false;
+}
+
 uint8_t Electroniccats_PN7150::configMode() {
   int mode = Electroniccats_PN7150::getMode();
   return Electroniccats_PN7150::ConfigMode(mode);
@@ -655,6 +752,7 @@ bool Electroniccats_PN7150::configureSettings(void) {
 
 #if NXP_CORE_STANDBY
   if (sizeof(NxpNci_CORE_STANDBY) != 0) {
+    NxpNci_CORE_STANDBY[3] = standbyEnabled ? 0x01 : 0x00;
     (void)(writeData(NxpNci_CORE_STANDBY, sizeof(NxpNci_CORE_STANDBY)));
     getMessage(10);
     if ((rxBuffer[0] != 0x4F) || (rxBuffer[1] != 0x00) ||
@@ -696,6 +794,10 @@ bool Electroniccats_PN7150::configureSettings(void) {
   /* Apply settings */
 #if NXP_CORE_CONF_EXTN
   if (sizeof(NxpNci_CORE_CONF_EXTN) != 0) {
+    NxpNci_CORE_CONF_EXTN[7] = tagDetectorCfg;
+    NxpNci_CORE_CONF_EXTN[11] = tagDetectorThreshold;
+    NxpNci_CORE_CONF_EXTN[15] = tagDetectorFallback;
+    NxpNci_CORE_CONF_EXTN_3rdGen[7] = tagDetectorCfg;
 
     if (_chipModel == PN7150)
       (void)writeData(NxpNci_CORE_CONF_EXTN, sizeof(NxpNci_CORE_CONF_EXTN));
@@ -1061,6 +1163,7 @@ bool Electroniccats_PN7150::configureSettings(uint8_t *uidcf, uint8_t uidlen) {
 
 #if NXP_CORE_STANDBY
   if (sizeof(NxpNci_CORE_STANDBY) != 0) {
+    NxpNci_CORE_STANDBY[3] = standbyEnabled ? 0x01 : 0x00;
     (void)(writeData(NxpNci_CORE_STANDBY, sizeof(NxpNci_CORE_STANDBY)));
     getMessage(10);
     if ((rxBuffer[0] != 0x4F) || (rxBuffer[1] != 0x00) ||
@@ -1102,6 +1205,10 @@ bool Electroniccats_PN7150::configureSettings(uint8_t *uidcf, uint8_t uidlen) {
   /* Apply settings */
 #if NXP_CORE_CONF_EXTN
   if (sizeof(NxpNci_CORE_CONF_EXTN) != 0) {
+    NxpNci_CORE_CONF_EXTN[7] = tagDetectorCfg;
+    NxpNci_CORE_CONF_EXTN[11] = tagDetectorThreshold;
+    NxpNci_CORE_CONF_EXTN[15] = tagDetectorFallback;
+    NxpNci_CORE_CONF_EXTN_3rdGen[7] = tagDetectorCfg;
 
     if (_chipModel == PN7150)
       (void)writeData(NxpNci_CORE_CONF_EXTN, sizeof(NxpNci_CORE_CONF_EXTN));
@@ -1272,6 +1379,7 @@ uint8_t Electroniccats_PN7150::startDiscovery() {
 bool Electroniccats_PN7150::stopDiscovery() {
   uint8_t NCIStopDiscovery[] = {0x21, 0x06, 0x01, 0x00};
 
+  hostSelectPending = false;
   (void)writeData(NCIStopDiscovery, sizeof(NCIStopDiscovery));
   getMessage(10);
 
@@ -1285,9 +1393,6 @@ bool Electroniccats_PN7150::StopDiscovery() {
 
 bool Electroniccats_PN7150::WaitForDiscoveryNotification(RfIntf_t *pRfIntf,
                                                          uint16_t tout) {
-  uint8_t NCIRfDiscoverSelect[] = {
-      0x21, 0x04, 0x03, 0x01, protocol.ISODEP, interface.ISODEP};
-
   // P2P Support
   uint8_t NCIStopDiscovery[] = {0x21, 0x06, 0x01, 0x00};
   uint8_t NCIRestartDiscovery[] = {0x21, 0x06, 0x01, 0x03};
@@ -1295,17 +1400,50 @@ bool Electroniccats_PN7150::WaitForDiscoveryNotification(RfIntf_t *pRfIntf,
 
   gNextTag_Protocol = PROT_UNDETERMINED;
   bool getFlag = false;
+  unsigned long start = millis();
+  unsigned long elapsed;
+  uint16_t remaining;
 wait:
   do {
-    getFlag = getMessage(
-        tout > 0 ? tout : 1337); // Infinite loop, waiting for response
+    /* tout bounds the whole wait, rejected tags included */
+    remaining = 1337; // Infinite loop, waiting for response
+    if (tout > 0) {
+      elapsed = millis() - start;
+      if (elapsed >= tout) {
+        getFlag = false;
+        break;
+      }
+      remaining = tout - elapsed;
+      /* 1337 asks getMessage() to wait forever */
+      if (remaining == 1337)
+        remaining--;
+    }
+    getFlag = getMessage(remaining);
+    /* Proprietary notification reported by the tag detector trace mode */
+    if (getFlag && (rxBuffer[0] == 0x6F) &&
+        (rxBuffer[1] == TAG_DETECTOR_TRACE_OID) &&
+        ((tagDetectorCfg & (TAG_DETECTOR_ENABLE | TAG_DETECTOR_TRACE)) ==
+         (TAG_DETECTOR_ENABLE | TAG_DETECTOR_TRACE)))
+      countTagDetectorWake();
   } while (((rxBuffer[0] != 0x61) ||
             ((rxBuffer[1] != 0x05) && (rxBuffer[1] != 0x03))) &&
            (getFlag == true));
   gNextTag_Protocol = PROT_UNDETERMINED;
 
+  /* Timeout, rxBuffer still holds the previous message */
+  if (!getFlag)
+    return ERROR;
+
+  /* The last wake up found a tag */
+  if (tagDetectorWakePending) {
+    tagDetectorStats.detections++;
+    tagDetectorWakePending = false;
+  }
+
   /* Is RF_INTF_ACTIVATED_NTF ? */
   if (rxBuffer[1] == 0x05) {
+    hostSelectPending = false;
+    selectedTagSwapped = false;
     pRfIntf->Interface = rxBuffer[4];
     remoteDevice.setInterface(rxBuffer[4]);
     pRfIntf->Protocol = rxBuffer[5];
@@ -1314,8 +1452,27 @@ wait:
     remoteDevice.setModeTech(rxBuffer[6]);
     pRfIntf->MoreTags = false;
     remoteDevice.setMoreTagsAvailable(false);
+    remoteDevice.setDiscoveryId(rxBuffer[3]);
+    remoteDevice.setMaxPayloadSize(rxBuffer[7]);
     remoteDevice.setInfo(pRfIntf, &rxBuffer[10]);
 
+    /* Only one target in the field, it is the whole inventory */
+    inventory[0] = remoteDevice;
+    inventoryCount = 1;
+    inventoryIndex = 0;
+    inventoryDropped = 0;
+
+    /* Rejected target, back to discovery without waking the application */
+    if (!discoveryFilter.accepts(&remoteDevice)) {
+      filteredTagCount++;
+      inventoryCount = 0;
+      inventory[0] = RemoteDevice();
+      (void)deactivateTarget(NCI_DEACTIVATE_DISCOVERY);
+      if ((tout > 0) && ((millis() - start) >= tout))
+        return ERROR;
+      goto wait;
+    }
+
     // P2P
     /* Verifying if not a P2P device also presenting T4T emulation */
     if ((pRfIntf->Interface == INTF_ISODEP) &&
@@ -1348,7 +1505,21 @@ wait:
             remoteDevice.setModeTech(rxBuffer[6]);
             pRfIntf->MoreTags = false;
             remoteDevice.setMoreTagsAvailable(false);
+            remoteDevice.setDiscoveryId(rxBuffer[3]);
+            remoteDevice.setMaxPayloadSize(rxBuffer[7]);
             remoteDevice.setInfo(pRfIntf, &rxBuffer[10]);
+            inventory[0] = remoteDevice;
+
+            /* The replacement target goes through the filter as well */
+            if (!discoveryFilter.accepts(&remoteDevice)) {
+              filteredTagCount++;
+              inventoryCount = 0;
+              inventory[0] = RemoteDevice();
+              (void)deactivateTarget(NCI_DEACTIVATE_DISCOVERY);
+              if ((tout > 0) && ((millis() - start) >= tout))
+                return ERROR;
+              goto wait;
+            }
             break;
           }
         } else {
@@ -1367,60 +1538,57 @@ wait:
       }
     }
   } else { /* RF_DISCOVER_NTF */
-    pRfIntf->Interface = INTF_UNDETERMINED;
-    remoteDevice.setInterface(interface.UNDETERMINED);
-    pRfIntf->Protocol = rxBuffer[4];
-    remoteDevice.setProtocol(rxBuffer[4]);
-    pRfIntf->ModeTech = rxBuffer[5];
-    remoteDevice.setModeTech(rxBuffer[5]);
-    pRfIntf->MoreTags = true;
-    remoteDevice.setMoreTagsAvailable(true);
-
-    /* Get next NTF for further activation */
-    do {
+    /* Collect every discovered target into the inventory table */
+    inventoryCount = 0;
+    inventoryIndex = 0;
+    inventoryDropped = 0;
+    addInventoryEntry();
+
+    /* Remaining NTF ? (Notification Type 0x02 means more to come) */
+    while (rxBuffer[rxMessageLength - 1] == 0x02) {
       if (!getMessage(100))
-        return ERROR;
-    } while ((rxBuffer[0] != 0x61) || (rxBuffer[1] != 0x03));
-    gNextTag_Protocol = rxBuffer[4];
-
-    /* Remaining NTF ? */
-
-    while (rxBuffer[rxMessageLength - 1] == 0x02)
-      getMessage(100);
+        break;
+      if ((rxBuffer[0] == 0x61) && (rxBuffer[1] == 0x03))
+        addInventoryEntry();
+    }
 
-    /* In case of multiple cards, select the first one */
-    NCIRfDiscoverSelect[4] = remoteDevice.getProtocol();
-    if (remoteDevice.getProtocol() == protocol.ISODEP)
-      NCIRfDiscoverSelect[5] = interface.ISODEP;
-    else if (remoteDevice.getProtocol() == protocol.NFCDEP)
-      NCIRfDiscoverSelect[5] = interface.NFCDEP;
-    else if (remoteDevice.getProtocol() == protocol.MIFARE)
-      NCIRfDiscoverSelect[5] = interface.TAGCMD;
-    else
-      NCIRfDiscoverSelect[5] = interface.FRAME;
+    /* The controller now waits for RF_DISCOVER_SELECT_CMD */
+    hostSelectPending = true;
 
-    (void)writeData(NCIRfDiscoverSelect, sizeof(NCIRfDiscoverSelect));
-    getMessage(100);
+    /* Every target was rejected, stop (Idle) and restart the discovery
+     * without selecting any */
+    if (inventoryCount == 0) {
+      inventory[0] = RemoteDevice();
+      (void)deactivateTarget(NCI_DEACTIVATE_DISCOVERY);
+      if ((tout > 0) && ((millis() - start) >= tout))
+        return ERROR;
+      goto wait;
+    }
 
-    if ((rxBuffer[0] == 0x41) || (rxBuffer[1] == 0x04) ||
-        (rxBuffer[3] == 0x00)) {
-      (void)writeData(rxBuffer, rxMessageLength);
-      getMessage(100);
+    if (inventoryCount > 1)
+      gNextTag_Protocol = inventory[1].getProtocol();
 
-      if ((rxBuffer[0] == 0x61) || (rxBuffer[1] == 0x05)) {
-        pRfIntf->Interface = rxBuffer[4];
-        remoteDevice.setInterface(rxBuffer[4]);
-        pRfIntf->Protocol = rxBuffer[5];
-        remoteDevice.setProtocol(rxBuffer[5]);
-        pRfIntf->ModeTech = rxBuffer[6];
-        remoteDevice.setModeTech(rxBuffer[6]);
-        remoteDevice.setInfo(pRfIntf, &rxBuffer[10]);
-      }
+    pRfIntf->Interface = INTF_UNDETERMINED;
+    remoteDevice.setInterface(interface.UNDETERMINED);
+    pRfIntf->Protocol = inventory[0].getProtocol();
+    remoteDevice.setProtocol(inventory[0].getProtocol());
+    pRfIntf->ModeTech = inventory[0].getModeTech();
+    remoteDevice.setModeTech(inventory[0].getModeTech());
+    pRfIntf->MoreTags = (inventoryCount > 1);
+    remoteDevice.setMoreTagsAvailable(inventoryCount > 1);
+
+    /* UID only: the discovery notifications already carry every UID, no
+     * target is activated */
+    if (uidOnlyMode)
+      return SUCCESS;
 
+    /* In case of multiple cards, select the first one */
+    if (selectInventoryEntry(0, pRfIntf) != SUCCESS) {
       /* In case of P2P target detected but lost, inform application to restart
          discovery */
-      else if (remoteDevice.getProtocol() == protocol.NFCDEP) {
+      if (inventory[0].getProtocol() == protocol.NFCDEP) {
         /* Restart the discovery loop */
+        hostSelectPending = false;
         (void)writeData(NCIStopDiscovery, sizeof(NCIStopDiscovery));
         getMessage();
         getMessage(100);
@@ -1443,8 +1611,338 @@ wait:
 }
 
 bool Electroniccats_PN7150::isTagDetected(uint16_t tout) {
-  return !Electroniccats_PN7150::WaitForDiscoveryNotification(
-      &this->dummyRfInterface, tout);
+  if (Electroniccats_PN7150::WaitForDiscoveryNotification(
+          &this->dummyRfInterface, tout))
+    return false;
+
+  repeatedTag = false;
+  if (uidCache.isEnabled())
+    repeatedTag = uidCache.seen(remoteDevice.getUID(),
+                                remoteDevice.getUIDLen(), millis());
+
+  if (repeatedTag && (uidCacheMode == UID_CACHE_SUPPRESS)) {
+    /* Same tag still inside its hold-off window, silently resume discovery */
+    (void)deactivateTarget(NCI_DEACTIVATE_DISCOVERY);
+    return false;
+  }
+
+  notifyTagArrived();
+  return true;
+}
+
+/*
+ * Callbacks get a copy owned by the driver, so the next detection does not
+ * change the data they are looking at
+ */
+void Electroniccats_PN7150::notifyTagArrived() {
+  /* Activated in listen mode: a reader is polling us */
+  if ((remoteDevice.getModeTech() & MODE_LISTEN) == MODE_LISTEN) {
+    readerDevice = remoteDevice;
+    if (readerFieldCallback != NULL)
+      readerFieldCallback(readerDevice.getRfIntf());
+    return;
+  }
+
+  arrivedTag = remoteDevice;
+  tagArrived = true;
+  mifareAuthSector = MIFARE_NO_SECTOR;
+  startPresenceMonitoring();
+  if (tagArrivedCallback != NULL)
+    tagArrivedCallback(arrivedTag.getRfIntf());
+}
+
+void Electroniccats_PN7150::notifyTagRemoved() {
+  if (!tagArrived)
+    return;
+
+  /* The tag left somewhere between the last positive check and now */
+  presenceStats.dwellTime = lastTagPresent - presenceStartTime;
+  presenceStats.removalLatency = millis() - lastTagPresent;
+  if (presenceStats.removalLatency > presenceStats.maxRemovalLatency)
+    presenceStats.maxRemovalLatency = presenceStats.removalLatency;
+
+  tagArrived = false;
+  if (tagRemovedCallback != NULL)
+    tagRemovedCallback(arrivedTag.getRfIntf());
+}
+
+void Electroniccats_PN7150::onTagArrived(TagCallback_t function) {
+  tagArrivedCallback = function;
+}
+
+void Electroniccats_PN7150::onTagRemoved(TagCallback_t function) {
+  tagRemovedCallback = function;
+}
+
+void Electroniccats_PN7150::onReaderField(TagCallback_t function) {
+  readerFieldCallback = function;
+}
+
+void Electroniccats_PN7150::startContinuousScan(bool readNdef,
+                                                unsigned long removalTimeout) {
+  continuousScan = true;
+  continuousScanNdef = readNdef;
+  scanRemovalTimeout = removalTimeout;
+  scanTagCount = 0;
+  droppedScanTagCount = 0;
+  tagEvents.clear();
+}
+
+void Electroniccats_PN7150::stopContinuousScan() { continuousScan = false; }
+
+bool Electroniccats_PN7150::isContinuousScanRunning() const {
+  return continuousScan;
+}
+
+/*
+ * Looks the tag up in tags and refreshes its last seen time, returns false if
+ * it is not there and there is no room left to add it
+ */
+static bool seeScanTag(ScanTag_t *tags, uint8_t *count,
+                       const RemoteDevice *pTag, unsigned long now,
+                       bool *added) {
+  uint8_t uidLen = pTag->getUIDLen();
+
+  *added = false;
+  for (uint8_t i = 0; i < *count; i++) {
+    if ((tags[i].uidLen == uidLen) &&
+        (memcmp(tags[i].uid, pTag->getUID(), uidLen) == 0)) {
+      tags[i].lastSeen = now;
+      return true;
+    }
+  }
+
+  if (*count >= CONTINUOUS_SCAN_MAX_TAGS)
+    return false;
+
+  memcpy(tags[*count].uid, pTag->getUID(), uidLen);
+  tags[*count].uidLen = uidLen;
+  tags[*count].arrived = false;
+  tags[*count].lastSeen = now;
+  (*count)++;
+  *added = true;
+  return true;
+}
+
+/*
+ * Returns 1 if the tag just entered the field, 0 if it was already there and
+ * -1 if it cannot be tracked. Tags that do not fit in the scan table are
+ * remembered apart, so each one counts as a single dropped event however long
+ * it stays in the field
+ */
+int8_t Electroniccats_PN7150::trackScanTag(const RemoteDevice *pTag,
+                                           unsigned long now) {
+  uint8_t uidLen = pTag->getUIDLen();
+  bool added;
+
+  if ((uidLen == 0) || (uidLen > TAG_EVENT_MAX_UID_SIZE))
+    return -1;
+
+  if (seeScanTag(scanTags, &scanTagCount, pTag, now, &added))
+    return added ? 1 : 0;
+
+  if (seeScanTag(droppedScanTags, &droppedScanTagCount, pTag, now, &added) &&
+      !added)
+    return 0;
+  return -1;
+}
+
+void Electroniccats_PN7150::pushTagEvent(uint8_t type,
+                                         const RemoteDevice *pTag,
+                                         unsigned short ndefSize) {
+  TagEvent_t event;
+
+  event.type = type;
+  event.uidLen = pTag->getUIDLen();
+  if (event.uidLen > TAG_EVENT_MAX_UID_SIZE)
+    event.uidLen = TAG_EVENT_MAX_UID_SIZE;
+  memcpy(event.uid, pTag->getUID(), event.uidLen);
+  event.protocol = pTag->getProtocol();
+  event.ndefSize = ndefSize;
+  event.timestamp = millis();
+  (void)tagEvents.push(&event);
+}
+
+void Electroniccats_PN7150::handleContinuousScan(uint16_t tout) {
+  unsigned long now;
+  TagEvent_t event;
+  uint8_t i, entry = 0;
+
+  if (!continuousScan)
+    return;
+
+  if (WaitForDiscoveryNotification(&this->dummyRfInterface, tout) ==
+      SUCCESS) {
+    now = millis();
+
+    for (i = 0; i < inventoryCount; i++) {
+      switch (trackScanTag(&inventory[i], now)) {
+      case 1:
+        /* New tags are appended to the scan table */
+        entry = scanTagCount - 1;
+        break;
+      case 0:
+        /* Already reported */
+        continue;
+      default:
+        tagEvents.countDropped();
+        continue;
+      }
+
+      pushTagEvent(TAG_EVENT_UID_SEEN, &inventory[i], 0);
+
+      if (uidOnlyMode) {
+        if (uidOnlyTagCount < 0xFFFFFFFF)
+          uidOnlyTagCount++;
+        if (uidCallback != NULL)
+          uidCallback(inventory[i].getUID(), inventory[i].getUIDLen());
+        continue;
+      }
+
+      if (!selectTag(i))
+        continue;
+      pushTagEvent(TAG_EVENT_ACTIVATED, &remoteDevice, 0);
+      notifyTagArrived();
+      scanTags[entry].arrived = true;
+      scanTagIntf[entry] = remoteDevice.getRfIntf();
+
+      if (continuousScanNdef) {
+        readNdefMessage();
+        pushTagEvent(TAG_EVENT_NDEF_READ, &remoteDevice,
+                     (ndefContext->pLastMessage != NULL)
+                         ? ndefContext->LastMessageSize
+                         : 0);
+      }
+    }
+
+    /* Release the tags and keep polling */
+    (void)deactivateTarget(NCI_DEACTIVATE_DISCOVERY);
+  }
+
+  /* Tags not seen for a while left the field */
+  now = millis();
+  i = 0;
+  while (i < scanTagCount) {
+    if ((now - scanTags[i].lastSeen) <= scanRemovalTimeout) {
+      i++;
+      continue;
+    }
+    event.type = TAG_EVENT_REMOVED;
+    memcpy(event.uid, scanTags[i].uid, scanTags[i].uidLen);
+    event.uidLen = scanTags[i].uidLen;
+    event.protocol = PROT_UNDETERMINED;
+    event.ndefSize = 0;
+    event.timestamp = now;
+    (void)tagEvents.push(&event);
+
+    /* One removal for each arrival. The last arrived tag goes through
+     * notifyTagRemoved() for the presence statistics, which does nothing if
+     * its removal was already reported */
+    if (scanTags[i].arrived) {
+      if ((arrivedTag.getUIDLen() == event.uidLen) &&
+          (memcmp(arrivedTag.getUID(), event.uid, event.uidLen) == 0))
+        notifyTagRemoved();
+      else if (tagRemovedCallback != NULL)
+        tagRemovedCallback(scanTagIntf[i]);
+    }
+    scanTagCount--;
+    scanTags[i] = scanTags[scanTagCount];
+    scanTagIntf[i] = scanTagIntf[scanTagCount];
+  }
+
+  /* Untracked tags gone, a later visit counts as a new dropped event */
+  i = 0;
+  while (i < droppedScanTagCount) {
+    if ((now - droppedScanTags[i].lastSeen) <= scanRemovalTimeout)
+      i++;
+    else
+      droppedScanTags[i] = droppedScanTags[--droppedScanTagCount];
+  }
+}
+
+bool Electroniccats_PN7150::startUidLogging() {
+  uidOnlyMode = true;
+  uidOnlyTagCount = 0;
+  uidOnlyStartTime = millis();
+
+  /* Discovery map must be rebuilt for the new ISO-DEP mapping */
+  if (configMode() || startDiscovery()) {
+    uidOnlyMode = false;
+    return false;
+  }
+
+  startContinuousScan(false, scanRemovalTimeout);
+  return true;
+}
+
+bool Electroniccats_PN7150::stopUidLogging() {
+  stopContinuousScan();
+  uidOnlyMode = false;
+
+  if (configMode() || startDiscovery())
+    return false;
+
+  return true;
+}
+
+bool Electroniccats_PN7150::isUidLoggingRunning() const {
+  return uidOnlyMode && continuousScan;
+}
+
+void Electroniccats_PN7150::setUidCallback(UidCallback_t function) {
+  uidCallback = function;
+}
+
+uint32_t Electroniccats_PN7150::getLoggedTagCount() const {
+  return uidOnlyTagCount;
+}
+
+float Electroniccats_PN7150::getTagsPerSecond() const {
+  unsigned long elapsed = millis() - uidOnlyStartTime;
+
+  if (elapsed == 0)
+    return 0;
+  return (uidOnlyTagCount * 1000.0) / elapsed;
+}
+
+bool Electroniccats_PN7150::getTagEvent(TagEvent_t *event) {
+  return tagEvents.pop(event);
+}
+
+uint8_t Electroniccats_PN7150::getTagEventCount() const {
+  return tagEvents.getCount();
+}
+
+uint16_t Electroniccats_PN7150::getDroppedTagEvents() const {
+  return tagEvents.getDropped();
+}
+
+bool Electroniccats_PN7150::addDiscoveryFilter(
+    const DiscoveryFilterRule_t *rule) {
+  return discoveryFilter.add(rule);
+}
+
+void Electroniccats_PN7150::clearDiscoveryFilters() {
+  discoveryFilter.clear();
+}
+
+uint32_t Electroniccats_PN7150::getFilteredTagCount() const {
+  return filteredTagCount;
+}
+
+void Electroniccats_PN7150::setUidCacheHoldOff(unsigned long holdOff) {
+  uidCache.setHoldOff(holdOff);
+}
+
+void Electroniccats_PN7150::setUidCacheMode(uint8_t mode) {
+  uidCacheMode = mode;
+}
+
+bool Electroniccats_PN7150::isRepeatedTag() const { return repeatedTag; }
+
+void Electroniccats_PN7150::clearUidCache() {
+  uidCache.clear();
+  repeatedTag = false;
 }
 
 bool Electroniccats_PN7150::cardModeSend(unsigned char *pData,
@@ -1672,10 +2170,11 @@ void Electroniccats_PN7150::ProcessP2pMode(RfIntf_t RfIntf) {
   Electroniccats_PN7150::processP2pMode(RfIntf);
 }
 
-void Electroniccats_PN7150::presenceCheck(RfIntf_t RfIntf) {
-  bool status;
+/*
+ * Single presence check of the activated tag, returns true if it answered
+ */
+bool Electroniccats_PN7150::checkTagPresence() {
   uint8_t i;
-  uint8_t idx = 0;
 
   uint8_t NCIPresCheckT1T[] = {0x00, 0x00, 0x07, 0x78, 0x00,
                                0x00, 0x00, 0x00, 0x00, 0x00};
@@ -1684,109 +2183,254 @@ void Electroniccats_PN7150::presenceCheck(RfIntf_t RfIntf) {
   uint8_t NCIPresCheckIsoDep[] = {0x2F, 0x11, 0x00};
   uint8_t NCIPresCheckIso15693[] = {0x00, 0x00, 0x0B, 0x26, 0x01, 0x40, 0x00,
                                     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-  uint8_t NCIDeactivate[] = {0x21, 0x06, 0x01, 0x01};
-  uint8_t NCISelectMIFARE[] = {0x21, 0x04, 0x03, 0x01, 0x80, 0x80};
 
   switch (remoteDevice.getProtocol()) {
   case PROT_T1T:
-    do {
-      delay(500);
-      (void)writeData(NCIPresCheckT1T, sizeof(NCIPresCheckT1T));
-      getMessage();
-      getMessage(100);
-    } while ((rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00));
-    break;
+    (void)writeData(NCIPresCheckT1T, sizeof(NCIPresCheckT1T));
+    getMessage();
+    getMessage(100);
+    return (rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00);
 
   case PROT_T2T:
-    do {
-      delay(500);
-      (void)writeData(NCIPresCheckT2T, sizeof(NCIPresCheckT2T));
-      getMessage();
-      getMessage(100);
-    } while ((rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00) &&
-             (rxBuffer[2] == 0x11));
-    break;
+    (void)writeData(NCIPresCheckT2T, sizeof(NCIPresCheckT2T));
+    getMessage();
+    getMessage(100);
+    return (rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00) &&
+           (rxBuffer[2] == 0x11);
 
   case PROT_T3T:
-    do {
-      delay(500);
-      (void)writeData(NCIPresCheckT3T, sizeof(NCIPresCheckT3T));
-      getMessage();
-      getMessage(100);
-    } while ((rxBuffer[0] == 0x61) && (rxBuffer[1] == 0x08) &&
-             ((rxBuffer[3] == 0x00) || (rxBuffer[4] > 0x00)));
-    break;
+    (void)writeData(NCIPresCheckT3T, sizeof(NCIPresCheckT3T));
+    getMessage();
+    getMessage(100);
+    return (rxBuffer[0] == 0x61) && (rxBuffer[1] == 0x08) &&
+           ((rxBuffer[3] == 0x00) || (rxBuffer[4] > 0x00));
 
   case PROT_ISODEP:
-    do {
-      delay(500);
-      (void)writeData(NCIPresCheckIsoDep, sizeof(NCIPresCheckIsoDep));
-      getMessage();
-      getMessage(100);
-    } while ((rxBuffer[0] == 0x6F) && (rxBuffer[1] == 0x11) &&
-             (rxBuffer[2] == 0x01) && (rxBuffer[3] == 0x01));
-    break;
+    (void)writeData(NCIPresCheckIsoDep, sizeof(NCIPresCheckIsoDep));
+    getMessage();
+    getMessage(100);
+    return (rxBuffer[0] == 0x6F) && (rxBuffer[1] == 0x11) &&
+           (rxBuffer[2] == 0x01) && (rxBuffer[3] == 0x01);
 
   case PROT_ISO15693:
-    do {
-      delay(500);
-      for (i = 0; i < 8; i++) {
-        NCIPresCheckIso15693[i + 6] = remoteDevice.getID()[7 - i];
-      }
-      (void)writeData(NCIPresCheckIso15693, sizeof(NCIPresCheckIso15693));
-      getMessage();
-      getMessage(100);
-      status = ERROR;
-      if (rxMessageLength)
-        status = SUCCESS;
-    } while ((status == SUCCESS) && (rxBuffer[0] == 0x00) &&
-             (rxBuffer[1] == 0x00) && (rxBuffer[rxMessageLength - 1] == 0x00));
-    break;
+    for (i = 0; i < 8; i++) {
+      NCIPresCheckIso15693[i + 6] = remoteDevice.getID()[7 - i];
+    }
+    (void)writeData(NCIPresCheckIso15693, sizeof(NCIPresCheckIso15693));
+    getMessage();
+    getMessage(100);
+    return (rxMessageLength != 0) && (rxBuffer[0] == 0x00) &&
+           (rxBuffer[1] == 0x00) && (rxBuffer[rxMessageLength - 1] == 0x00);
 
   case PROT_MIFARE:
-    do {
-      delay(500);
-      /* Deactivate target */
-      (void)writeData(NCIDeactivate, sizeof(NCIDeactivate));
-      getMessage();
-      getMessage(100);
+    return checkMifarePresence();
 
-      // Skip leading 0xFF
-      while (idx < (int)rxMessageLength && rxBuffer[idx] == 0xFF) {
-        idx++;
-      }
+  default:
+    /* Nothing to check */
+    return false;
+  }
+}
 
-      /* Reactivate target */
-      (void)writeData(NCISelectMIFARE, sizeof(NCISelectMIFARE));
-      getMessage();
-      getMessage(100);
+/*
+ * MIFARE Classic has no presence check command. Re-selecting always works
+ * but drops the authentication, reading the last authenticated block keeps
+ * the tag activated and authenticated
+ */
+bool Electroniccats_PN7150::checkMifarePresence() {
+  uint8_t NCIDeactivate[] = {0x21, 0x06, 0x01, 0x01};
+  uint8_t NCISelectMIFARE[] = {0x21, 0x04, 0x03, 0x01, 0x80, 0x80};
+  uint8_t NCIReadMIFARE[] = {0x00, 0x00, 0x03, 0x10, 0x30, 0x00};
+  uint8_t strategy = mifarePresenceStrategy;
+  unsigned long start = micros();
+  PresenceCheckStats_t *pStats;
+  bool present;
+  uint8_t idx = 0;
 
-      // Again skip leading 0xFF in the new response
-      idx = 0;
-      while (idx < (int)rxMessageLength && rxBuffer[idx] == 0xFF) {
-        idx++;
-      }
+  /* Reading needs an authenticated sector, otherwise the tag would halt */
+  if (mifareAuthSector == MIFARE_NO_SECTOR)
+    strategy = MIFARE_PRESENCE_RESELECT;
 
-      // Make sure we don't go out of bounds
-      if (idx + 1 >= (int)rxMessageLength) {
-        // If we've run out of data, assume card removed
-        break;
-      }
+  if (strategy == MIFARE_PRESENCE_READ_BLOCK) {
+    NCIReadMIFARE[5] = (mifareAuthSector < 32)
+                           ? mifareAuthSector * 4
+                           : 128 + (mifareAuthSector - 32) * 16;
+    (void)writeData(NCIReadMIFARE, sizeof(NCIReadMIFARE));
+    getMessage();
+    getMessage(100);
 
-    } while ((rxBuffer[idx] == 0x61) && (rxBuffer[idx + 1] == 0x05));
-    break;
+    /* XCHG prefix, 16 data bytes and the status */
+    present = (rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00) &&
+              (rxBuffer[2] == 18) && (rxBuffer[rxMessageLength - 1] == 0x00);
+    if (!present)
+      mifareAuthSector = MIFARE_NO_SECTOR;
+  } else {
+    /* Deactivate target */
+    (void)writeData(NCIDeactivate, sizeof(NCIDeactivate));
+    getMessage();
+    getMessage(100);
 
-  default:
-    /* Nothing to do */
-    break;
+    /* Reactivate target */
+    (void)writeData(NCISelectMIFARE, sizeof(NCISelectMIFARE));
+    getMessage();
+    getMessage(100);
+
+    // Skip leading 0xFF in the response
+    while (idx < (int)rxMessageLength && rxBuffer[idx] == 0xFF) {
+      idx++;
+    }
+
+    // Make sure we don't go out of bounds, if we've run out of data, assume
+    // card removed
+    present = (idx + 1 < (int)rxMessageLength) && (rxBuffer[idx] == 0x61) &&
+              (rxBuffer[idx + 1] == 0x05);
+    mifareAuthSector = MIFARE_NO_SECTOR;
   }
+
+  pStats = &mifarePresenceStats[strategy];
+  pStats->lastTime = micros() - start;
+  pStats->totalTime += pStats->lastTime;
+  pStats->checks++;
+
+  return present;
 }
 
-void Electroniccats_PN7150::waitForTagRemoval() {
-  Electroniccats_PN7150::presenceCheck(this->dummyRfInterface);
+void Electroniccats_PN7150::setMifarePresenceCheck(uint8_t strategy) {
+  if (strategy <= MIFARE_PRESENCE_READ_BLOCK)
+    mifarePresenceStrategy = strategy;
 }
 
-// Deprecated, use waitForTagRemoval() instead
+const PresenceCheckStats_t *
+Electroniccats_PN7150::getMifarePresenceStats(uint8_t strategy) const {
+  if (strategy > MIFARE_PRESENCE_READ_BLOCK)
+    return NULL;
+  return &mifarePresenceStats[strategy];
+}
+
+uint8_t Electroniccats_PN7150::presenceIntervalIndex(uint8_t protocol) {
+  /* MIFARE Classic (0x80) takes the slot after ISO15693 */
+  if (protocol == PROT_MIFARE)
+    return PRESENCE_CHECK_PROTOCOLS - 1;
+  if (protocol >= PRESENCE_CHECK_PROTOCOLS - 1)
+    return PROT_UNDETERMINED;
+  return protocol;
+}
+
+void Electroniccats_PN7150::setPresenceCheckInterval(uint16_t interval) {
+  for (uint8_t i = 0; i < PRESENCE_CHECK_PROTOCOLS; i++)
+    presenceCheckInterval[i] = interval;
+}
+
+void Electroniccats_PN7150::setPresenceCheckInterval(uint8_t protocol,
+                                                     uint16_t interval) {
+  presenceCheckInterval[presenceIntervalIndex(protocol)] = interval;
+}
+
+uint16_t Electroniccats_PN7150::getPresenceCheckInterval(uint8_t protocol) {
+  return presenceCheckInterval[presenceIntervalIndex(protocol)];
+}
+
+/*
+ * Adaptive mode polls quickly right after activation, where short taps
+ * leave, and backs off to a fraction of the time the tag already stayed
+ */
+uint16_t Electroniccats_PN7150::presenceInterval() {
+  unsigned long interval;
+
+  if (adaptiveMaxInterval == 0)
+    return getPresenceCheckInterval(remoteDevice.getProtocol());
+
+  interval = (millis() - presenceStartTime) / PRESENCE_ADAPTIVE_DIVISOR;
+  if (interval < adaptiveMinInterval)
+    return adaptiveMinInterval;
+  if (interval > adaptiveMaxInterval)
+    return adaptiveMaxInterval;
+  return interval;
+}
+
+bool Electroniccats_PN7150::trackTagPresence() {
+  bool present = checkTagPresence();
+
+  presenceStats.checks++;
+  presenceStats.totalChecks++;
+  if (present)
+    lastTagPresent = millis();
+  return present;
+}
+
+void Electroniccats_PN7150::startPresenceMonitoring() {
+  presenceMonitoring = true;
+  presenceStartTime = millis();
+  lastTagPresent = presenceStartTime;
+  presenceStats.checks = 0;
+  nextPresenceCheck = presenceStartTime + presenceInterval();
+}
+
+void Electroniccats_PN7150::setAdaptivePresenceCheck(uint16_t minInterval,
+                                                     uint16_t maxInterval) {
+  if (maxInterval < minInterval)
+    maxInterval = minInterval;
+  adaptiveMinInterval = minInterval;
+  adaptiveMaxInterval = maxInterval;
+}
+
+const PresenceStats_t *Electroniccats_PN7150::getPresenceStats() const {
+  return &presenceStats;
+}
+
+void Electroniccats_PN7150::clearPresenceStats() {
+  memset(&presenceStats, 0, sizeof(presenceStats));
+}
+
+/*
+ * Non blocking removal detection, checks the tag only when its interval
+ * expired so the application can keep talking to it in between
+ */
+bool Electroniccats_PN7150::isTagRemoved() {
+  unsigned long now = millis();
+
+  if (!presenceMonitoring)
+    return true;
+
+  if ((long)(now - nextPresenceCheck) < 0)
+    return false;
+
+  if (trackTagPresence()) {
+    nextPresenceCheck = millis() + presenceInterval();
+    return false;
+  }
+
+  presenceMonitoring = false;
+  notifyTagRemoved();
+  return true;
+}
+
+void Electroniccats_PN7150::presenceCheck(RfIntf_t RfIntf) {
+  switch (remoteDevice.getProtocol()) {
+  case PROT_T1T:
+  case PROT_T2T:
+  case PROT_T3T:
+  case PROT_ISODEP:
+  case PROT_ISO15693:
+  case PROT_MIFARE:
+    do {
+      delay(presenceInterval());
+    } while (trackTagPresence());
+    break;
+
+  default:
+    /* Nothing to do */
+    return;
+  }
+
+  presenceMonitoring = false;
+  notifyTagRemoved();
+}
+
+void Electroniccats_PN7150::waitForTagRemoval() {
+  Electroniccats_PN7150::presenceCheck(this->dummyRfInterface);
+}
+
+// Deprecated, use waitForTagRemoval() instead
 void Electroniccats_PN7150::PresenceCheck(RfIntf_t RfIntf) {
   Electroniccats_PN7150::presenceCheck(RfIntf);
 }
@@ -1823,6 +2467,15 @@ bool Electroniccats_PN7150::readerTagCmd(unsigned char *pCommand,
   *pAnswerSize = rxBuffer[2];
   memcpy(pAnswer, &rxBuffer[3], *pAnswerSize);
 
+  /* Remember the MIFARE sector authenticated for the presence check */
+  if ((remoteDevice.getProtocol() == protocol.MIFARE) &&
+      (pCommand[0] == 0x40) && (CommandSize >= 2)) {
+    if ((status == SUCCESS) && (*pAnswerSize == 2) && (pAnswer[1] == 0x00))
+      mifareAuthSector = pCommand[1];
+    else
+      mifareAuthSector = MIFARE_NO_SECTOR;
+  }
+
 #ifdef DEBUG2
   Serial.print("*pAnswerSize ");
   Serial.println(*pAnswerSize);
@@ -1842,6 +2495,360 @@ bool Electroniccats_PN7150::ReaderTagCmd(unsigned char *pCommand,
                                              pAnswerSize);
 }
 
+bool Electroniccats_PN7150::addMifareKey(const unsigned char *key,
+                                         uint8_t keyType, uint8_t sector) {
+  return mifareKeys.addKey(key, keyType, sector);
+}
+
+void Electroniccats_PN7150::clearMifareKeys() { mifareKeys.clearKeys(); }
+
+/*
+ * With several tags in the field the re-activated tag is only taken for the
+ * selected one when its UID matches. Otherwise the operation in progress must
+ * not go on, nor any later one until a tag is activated again
+ */
+bool Electroniccats_PN7150::reActivateSelectedTag() {
+  RemoteDevice tag = RemoteDevice();
+  RfIntf_t RfIntf;
+  uint8_t uidLen;
+
+  if (readerReActivate() != SUCCESS)
+    return false;
+
+  tag.setModeTech(rxBuffer[6]);
+  tag.setInfo(&RfIntf, &rxBuffer[10]);
+  uidLen = remoteDevice.getUIDLen();
+  if ((tag.getUIDLen() != uidLen) ||
+      ((uidLen != 0) &&
+       (memcmp(tag.getUID(), remoteDevice.getUID(), uidLen) != 0))) {
+    selectedTagSwapped = true;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * A refused authentication halts the tag, it is re-activated so that the next
+ * key or command can be sent
+ */
+bool Electroniccats_PN7150::tryMifareKey(uint8_t index, uint8_t sector) {
+  unsigned char Auth[MIFARE_AUTH_CMD_SIZE];
+  unsigned char Answer[MAX_NCI_FRAME_SIZE];
+  unsigned char AnswerSize = 0;
+  uint8_t AuthSize = mifareKeys.authCommand(index, sector, Auth);
+  bool accepted;
+
+  mifareKeyStats.attempts++;
+  accepted = (readerTagCmd(Auth, AuthSize, Answer, &AnswerSize) == SUCCESS) &&
+             (AnswerSize >= 2) && (Answer[AnswerSize - 1] == 0x00);
+  if (!accepted)
+    (void)reActivateSelectedTag();
+  return accepted;
+}
+
+/*
+ * The key which last authenticated this sector of this tag is tried first,
+ * then the other keys for the sector in the order they were added
+ */
+bool Electroniccats_PN7150::mifareAuthenticate(uint8_t sector) {
+  const unsigned char *uid = remoteDevice.getUID();
+  uint8_t uidLen = remoteDevice.getUIDLen();
+  int8_t cached;
+  bool tried;
+
+  if ((remoteDevice.getProtocol() != PROT_MIFARE) || selectedTagSwapped)
+    return ERROR;
+
+  cached = mifareKeys.getCachedKey(uid, uidLen, sector);
+  if (cached != MIFARE_NO_KEY) {
+    if (tryMifareKey(cached, sector)) {
+      mifareKeyStats.hits++;
+      return SUCCESS;
+    }
+    mifareKeys.forgetCachedKey(uid, uidLen, sector);
+  }
+
+  tried = (cached != MIFARE_NO_KEY);
+  for (uint8_t i = 0; (i < mifareKeys.getKeyCount()) && !selectedTagSwapped;
+       i++) {
+    if ((i == cached) || !mifareKeys.isKeyFor(i, sector))
+      continue;
+    tried = true;
+    if (tryMifareKey(i, sector)) {
+      mifareKeyStats.misses++;
+      mifareKeys.setCachedKey(uid, uidLen, sector, i);
+      return SUCCESS;
+    }
+  }
+
+  /* Keys left untried on another tag say nothing about the key ring */
+  if (tried && !selectedTagSwapped) {
+    mifareKeyStats.misses++;
+    mifareKeyStats.failures++;
+  }
+  return ERROR;
+}
+
+const MifareKeyStats_t *Electroniccats_PN7150::getMifareKeyStats() const {
+  return &mifareKeyStats;
+}
+
+void Electroniccats_PN7150::clearMifareKeyStats() {
+  memset(&mifareKeyStats, 0, sizeof(mifareKeyStats));
+}
+
+static uint8_t mifareSectorBlock(uint8_t sector) {
+  return (sector < 32) ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+static uint8_t mifareSectorSize(uint8_t sector) {
+  return (sector < 32) ? 4 : 16;
+}
+
+uint16_t Electroniccats_PN7150::getMifareSectorBlocks(uint8_t first,
+                                                      uint8_t count,
+                                                      bool trailers) const {
+  uint16_t blocks = 0;
+
+  for (uint16_t sector = first;
+       (sector < MIFARE_MAX_SECTORS) && (sector < first + count); sector++)
+    blocks += mifareSectorSize(sector) - (trailers ? 0 : 1);
+  return blocks;
+}
+
+/*
+ * Each sector is authenticated once with the key ring, then its blocks are
+ * transferred in sequence. A refused block halts the tag, it is re-activated
+ * and the sector authenticated again so that the next blocks are still done.
+ * Once another tag answered the re-activation, nothing more is transferred
+ */
+uint16_t Electroniccats_PN7150::transferMifareSectors(
+    uint8_t first, uint8_t count, unsigned char *data, uint8_t *blockStatus,
+    bool trailers, bool write) {
+  uint8_t WriteAck = (_chipModel == PN7160) ? 0x14 : 0x00;
+  unsigned char Cmd[1 + MIFARE_BLOCK_SIZE];
+  unsigned char Answer[MAX_NCI_FRAME_SIZE];
+  unsigned char AnswerSize = 0;
+  uint16_t done = 0;
+  uint16_t n = 0;
+
+  for (uint16_t sector = first;
+       (sector < MIFARE_MAX_SECTORS) && (sector < first + count); sector++) {
+    uint8_t blocks = mifareSectorSize(sector) - (trailers ? 0 : 1);
+    bool authenticated = (mifareAuthenticate(sector) == SUCCESS);
+
+    for (uint8_t i = 0; i < blocks; i++, n++) {
+      bool ok;
+
+      if (selectedTagSwapped) {
+        blockStatus[n] = MIFARE_BLOCK_ERROR;
+        continue;
+      }
+      if (!authenticated) {
+        blockStatus[n] = MIFARE_BLOCK_AUTH_ERROR;
+        continue;
+      }
+
+      Cmd[0] = 0x10;
+      Cmd[1] = write ? 0xA0 : 0x30;
+      Cmd[2] = mifareSectorBlock(sector) + i;
+      ok = (readerTagCmd(Cmd, 3, Answer, &AnswerSize) == SUCCESS) &&
+           (AnswerSize >= 2) &&
+           (Answer[AnswerSize - 1] == (write ? WriteAck : 0x00));
+
+      if (ok && write) {
+        /* Block content, once the tag accepted the WRITE command */
+        memcpy(&Cmd[1], &data[n * MIFARE_BLOCK_SIZE], MIFARE_BLOCK_SIZE);
+        ok = (readerTagCmd(Cmd, sizeof(Cmd), Answer, &AnswerSize) ==
+              SUCCESS) &&
+             (AnswerSize >= 2) && (Answer[AnswerSize - 1] == WriteAck);
+      } else if (ok) {
+        ok = (AnswerSize == MIFARE_BLOCK_SIZE + 2);
+        if (ok)
+          memcpy(&data[n * MIFARE_BLOCK_SIZE], &Answer[1], MIFARE_BLOCK_SIZE);
+      }
+
+      blockStatus[n] = ok ? MIFARE_BLOCK_OK : MIFARE_BLOCK_ERROR;
+      if (ok)
+        done++;
+      else if (reActivateSelectedTag() && (i + 1 < blocks))
+        authenticated = (mifareAuthenticate(sector) == SUCCESS);
+    }
+  }
+  return done;
+}
+
+uint16_t Electroniccats_PN7150::readMifareSectors(uint8_t first, uint8_t count,
+                                                  unsigned char *data,
+                                                  uint8_t *blockStatus,
+                                                  bool trailers) {
+  return transferMifareSectors(first, count, data, blockStatus, trailers,
+                               false);
+}
+
+uint16_t Electroniccats_PN7150::writeMifareSectors(uint8_t first,
+                                                   uint8_t count,
+                                                   const unsigned char *data,
+                                                   uint8_t *blockStatus,
+                                                   bool trailers) {
+  return transferMifareSectors(first, count, (unsigned char *)data,
+                               blockStatus, trailers, true);
+}
+
+#define ISO15693_SLOT_EMPTY 0
+#define ISO15693_SLOT_TAG 1
+#define ISO15693_SLOT_COLLISION 2
+
+uint8_t Electroniccats_PN7150::iso15693InventorySlot(const uint8_t *mask,
+                                                     uint8_t maskLen,
+                                                     bool useAfi, uint8_t afi,
+                                                     ISO15693Tag_t *pTag) {
+  uint8_t Cmd[3 + 4 + ISO15693_UID_SIZE];
+  uint8_t CmdSize = 3;
+  uint8_t maskBytes = (maskLen + 7) / 8;
+
+  /* Flags: high data rate, inventory, 1 slot and optionally AFI present */
+  Cmd[CmdSize++] = useAfi ? 0x36 : 0x26;
+  Cmd[CmdSize++] = 0x01; /* INVENTORY */
+  if (useAfi)
+    Cmd[CmdSize++] = afi;
+  Cmd[CmdSize++] = maskLen;
+  memcpy(&Cmd[CmdSize], mask, maskBytes);
+  CmdSize += maskBytes;
+  /* Bits beyond the mask length must be zero */
+  if (maskLen % 8)
+    Cmd[CmdSize - 1] &= (1 << (maskLen % 8)) - 1;
+
+  Cmd[0] = 0x00;
+  Cmd[1] = 0x00;
+  Cmd[2] = CmdSize - 3;
+  (void)writeData(Cmd, CmdSize);
+
+  /* Skip credit notifications until the answer or an error is reported */
+  do {
+    if (!getMessage(100))
+      return ISO15693_SLOT_EMPTY;
+  } while ((rxBuffer[0] == 0x60) && (rxBuffer[1] == 0x06));
+
+  if ((rxBuffer[0] == 0x00) && (rxBuffer[1] == 0x00)) {
+    /* Flags, DSFID, UID and the RF status byte added by the frame interface */
+    if ((rxBuffer[2] == 2 + ISO15693_UID_SIZE + 1) &&
+        (rxBuffer[rxMessageLength - 1] == 0x00) && !(rxBuffer[3] & 0x01)) {
+      pTag->dsfid = rxBuffer[4];
+      for (uint8_t i = 0; i < ISO15693_UID_SIZE; i++)
+        pTag->uid[i] = rxBuffer[5 + ISO15693_UID_SIZE - 1 - i];
+      return ISO15693_SLOT_TAG;
+    }
+    return ISO15693_SLOT_COLLISION;
+  }
+
+  /* CORE_INTERFACE_ERROR_NTF with timeout status means nobody answered */
+  if ((rxBuffer[0] == 0x60) && (rxBuffer[1] == 0x08) && (rxBuffer[3] == 0xB2))
+    return ISO15693_SLOT_EMPTY;
+
+  return ISO15693_SLOT_COLLISION;
+}
+
+void Electroniccats_PN7150::iso15693InventoryRound(
+    uint8_t *mask, uint8_t maskLen, bool useAfi, uint8_t afi,
+    ISO15693Tag_t *tags, uint8_t maxTags, uint8_t *pCount) {
+  uint16_t collisions = 0;
+  unsigned long start = millis();
+  uint8_t round = iso15693Stats.rounds;
+  ISO15693Tag_t tag;
+  uint8_t slot, i;
+
+  /*
+   * The frame RF interface cannot send the EOF used to switch slots, so each
+   * slot of the 16 slots round is emulated with a 1 slot request whose mask
+   * is extended with the slot number
+   */
+  for (slot = 0; slot < 16; slot++) {
+    if (maskLen % 8)
+      mask[maskLen / 8] = (mask[maskLen / 8] & 0x0F) | (slot << 4);
+    else
+      mask[maskLen / 8] = slot;
+
+    switch (iso15693InventorySlot(mask, maskLen + 4, useAfi, afi, &tag)) {
+    case ISO15693_SLOT_TAG:
+      for (i = 0; i < *pCount; i++) {
+        if (!memcmp(tags[i].uid, tag.uid, ISO15693_UID_SIZE))
+          break;
+      }
+      if (i < *pCount)
+        break;
+      if (*pCount < maxTags)
+        tags[(*pCount)++] = tag;
+      else
+        iso15693Stats.dropped++;
+      break;
+
+    case ISO15693_SLOT_COLLISION:
+      collisions |= (1 << slot);
+      iso15693Stats.collisions++;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  if (round < ISO15693_MAX_INVENTORY_ROUNDS)
+    iso15693Stats.roundTime[round] = millis() - start;
+  if (iso15693Stats.rounds < 0xFF)
+    iso15693Stats.rounds++;
+
+  /* Resolve collisions with 4 more mask bits, up to the full 64 bits UID */
+  if (maskLen + 4 >= ISO15693_UID_SIZE * 8)
+    return;
+
+  for (slot = 0; slot < 16; slot++) {
+    if (!(collisions & (1 << slot)))
+      continue;
+    if (maskLen % 8)
+      mask[maskLen / 8] = (mask[maskLen / 8] & 0x0F) | (slot << 4);
+    else
+      mask[maskLen / 8] = slot;
+    iso15693InventoryRound(mask, maskLen + 4, useAfi, afi, tags, maxTags,
+                           pCount);
+  }
+}
+
+uint8_t Electroniccats_PN7150::iso15693Inventory(ISO15693Tag_t *tags,
+                                                 uint8_t maxTags, bool useAfi,
+                                                 uint8_t afi) {
+  uint8_t mask[ISO15693_UID_SIZE] = {0};
+  uint8_t count = 0;
+  unsigned long start = millis();
+
+  memset(&iso15693Stats, 0, sizeof(iso15693Stats));
+
+  /* Requests are sent as raw frames, an ISO15693 tag must be activated */
+  if ((remoteDevice.getProtocol() != protocol.ISO15693) ||
+      (remoteDevice.getInterface() != interface.FRAME))
+    return 0;
+
+  iso15693InventoryRound(mask, 0, useAfi, afi, tags, maxTags, &count);
+  iso15693Stats.totalTime = millis() - start;
+
+  return count;
+}
+
+uint8_t Electroniccats_PN7150::inventoryISO15693(ISO15693Tag_t *tags,
+                                                 uint8_t maxTags) {
+  return iso15693Inventory(tags, maxTags, false, 0x00);
+}
+
+uint8_t Electroniccats_PN7150::inventoryISO15693(ISO15693Tag_t *tags,
+                                                 uint8_t maxTags, uint8_t afi) {
+  return iso15693Inventory(tags, maxTags, true, afi);
+}
+
+const ISO15693InventoryStats_t *
+Electroniccats_PN7150::getISO15693InventoryStats() const {
+  return &iso15693Stats;
+}
+
 bool Electroniccats_PN7150::readerReActivate() {
   uint8_t NCIDeactivate[] = {0x21, 0x06, 0x01, 0x01};
   uint8_t NCIActivate[] = {0x21, 0x04, 0x03, 0x01, 0x00, 0x00};
@@ -1851,7 +2858,8 @@ bool Electroniccats_PN7150::readerReActivate() {
   getMessage();
   getMessage(100);
 
-  /* Then re-activate the target */
+  /* Then re-activate the target, the one selected among the inventory */
+  NCIActivate[3] = remoteDevice.getDiscoveryId();
   NCIActivate[4] = remoteDevice.getProtocol();
   NCIActivate[5] = remoteDevice.getInterface();
 
@@ -1870,16 +2878,12 @@ bool Electroniccats_PN7150::ReaderReActivate(RfIntf_t *pRfIntf) {
 }
 
 bool Electroniccats_PN7150::ReaderActivateNext(RfIntf_t *pRfIntf) {
-  uint8_t NCIStopDiscovery[] = {0x21, 0x06, 0x01, 0x01};
-  uint8_t NCIRfDiscoverSelect[] = {0x21, 0x04,        0x03,
-                                   0x02, PROT_ISODEP, INTF_ISODEP};
-
-  bool status = ERROR;
+  uint8_t next = inventoryIndex + 1;
 
   pRfIntf->MoreTags = false;
   remoteDevice.setMoreTagsAvailable(false);
 
-  if (gNextTag_Protocol == protocol.UNDETERMINED) {
+  if (next >= inventoryCount) {
     pRfIntf->Interface = INTF_UNDETERMINED;
     remoteDevice.setInterface(interface.UNDETERMINED);
     pRfIntf->Protocol = PROT_UNDETERMINED;
@@ -1887,63 +2891,216 @@ bool Electroniccats_PN7150::ReaderActivateNext(RfIntf_t *pRfIntf) {
     return ERROR;
   }
 
-  /* First disconnect current tag */
-  (void)writeData(NCIStopDiscovery, sizeof(NCIStopDiscovery));
-  getMessage();
-
-  if ((rxBuffer[0] != 0x41) && (rxBuffer[1] != 0x06) && (rxBuffer[3] != 0x00))
+  /* First disconnect current tag, if any was activated */
+  if (!hostSelectPending &&
+      (deactivateTarget(NCI_DEACTIVATE_SLEEP) != SUCCESS))
     return ERROR;
-  getMessage(100);
 
-  if ((rxBuffer[0] != 0x61) && (rxBuffer[1] != 0x06))
-    return ERROR;
+  return selectInventoryEntry(next, pRfIntf);
+}
+
+bool Electroniccats_PN7150::activateNextTagDiscovery() {
+  return !Electroniccats_PN7150::ReaderActivateNext(&this->dummyRfInterface);
+}
+
+void Electroniccats_PN7150::addInventoryEntry() {
+  RemoteDevice *pTag;
+
+  /* No room left, counted so the application knows the inventory is partial */
+  if (inventoryCount >= NFC_MAX_INVENTORY_SIZE) {
+    if (inventoryDropped < 0xFF)
+      inventoryDropped++;
+    return;
+  }
+
+  /* RF_DISCOVER_NTF: ID, protocol, mode/tech, params length, params */
+  pTag = &inventory[inventoryCount];
+  pTag->setDiscoveryId(rxBuffer[3]);
+  pTag->setInterface(interface.UNDETERMINED);
+  pTag->setProtocol(rxBuffer[4]);
+  pTag->setModeTech(rxBuffer[5]);
+  pTag->setMoreTagsAvailable(false);
+  pTag->setDiscoveryInfo(&rxBuffer[7]);
 
-  NCIRfDiscoverSelect[4] = gNextTag_Protocol;
-  if (gNextTag_Protocol == PROT_ISODEP)
+  /* Rejected targets are left out of the inventory and never selected */
+  if (!discoveryFilter.accepts(pTag)) {
+    filteredTagCount++;
+    return;
+  }
+  inventoryCount++;
+}
+
+uint8_t Electroniccats_PN7150::selectInventoryEntry(uint8_t index,
+                                                    RfIntf_t *pRfIntf) {
+  uint8_t NCIRfDiscoverSelect[] = {0x21, 0x04,        0x03,
+                                   0x01, PROT_ISODEP, INTF_ISODEP};
+  uint8_t tagProtocol = inventory[index].getProtocol();
+
+  NCIRfDiscoverSelect[3] = inventory[index].getDiscoveryId();
+  NCIRfDiscoverSelect[4] = tagProtocol;
+  if (tagProtocol == PROT_ISODEP)
     NCIRfDiscoverSelect[5] = INTF_ISODEP;
-  else if (gNextTag_Protocol == PROT_ISODEP)
+  else if (tagProtocol == PROT_NFCDEP)
     NCIRfDiscoverSelect[5] = INTF_NFCDEP;
-  else if (gNextTag_Protocol == PROT_MIFARE)
+  else if (tagProtocol == PROT_MIFARE)
     NCIRfDiscoverSelect[5] = INTF_TAGCMD;
   else
     NCIRfDiscoverSelect[5] = INTF_FRAME;
 
   (void)writeData(NCIRfDiscoverSelect, sizeof(NCIRfDiscoverSelect));
-  getMessage();
+  getMessage(100);
+  if ((rxBuffer[0] != 0x41) || (rxBuffer[1] != 0x04) || (rxBuffer[3] != 0x00))
+    return ERROR;
 
-  if ((rxBuffer[0] == 0x41) && (rxBuffer[1] == 0x04) && (rxBuffer[3] == 0x00)) {
+  getMessage(100);
+  if ((rxBuffer[0] != 0x61) || (rxBuffer[1] != 0x05))
+    return ERROR;
+
+  pRfIntf->Interface = rxBuffer[4];
+  remoteDevice.setInterface(rxBuffer[4]);
+  pRfIntf->Protocol = rxBuffer[5];
+  remoteDevice.setProtocol(rxBuffer[5]);
+  pRfIntf->ModeTech = rxBuffer[6];
+  remoteDevice.setModeTech(rxBuffer[6]);
+  pRfIntf->MoreTags = (index + 1 < inventoryCount);
+  remoteDevice.setMoreTagsAvailable(index + 1 < inventoryCount);
+  remoteDevice.setDiscoveryId(rxBuffer[3]);
+  remoteDevice.setMaxPayloadSize(rxBuffer[7]);
+  remoteDevice.setInfo(pRfIntf, &rxBuffer[10]);
+
+  /* Keep the inventory entry up to date with the activation parameters */
+  inventory[index] = remoteDevice;
+  inventoryIndex = index;
+  hostSelectPending = false;
+  selectedTagSwapped = false;
+
+  return SUCCESS;
+}
+
+uint8_t Electroniccats_PN7150::deactivateTarget(uint8_t type) {
+  uint8_t NCIDeactivate[] = {0x21, 0x06, 0x01, NCI_DEACTIVATE_IDLE};
+
+  /* Nothing activated (RFST_W4_HOST_SELECT), only Idle is allowed: stop, then
+   * restart the discovery unless Idle was asked for */
+  if (hostSelectPending) {
+    hostSelectPending = false;
+    (void)writeData(NCIDeactivate, sizeof(NCIDeactivate));
+    getMessage();
+    if ((rxBuffer[0] != 0x41) || (rxBuffer[1] != 0x06) ||
+        (rxBuffer[3] != 0x00))
+      return ERROR;
     getMessage(100);
-    if ((rxBuffer[0] == 0x61) || (rxBuffer[1] == 0x05)) {
-      pRfIntf->Interface = rxBuffer[4];
-      remoteDevice.setInterface(rxBuffer[4]);
-      pRfIntf->Protocol = rxBuffer[5];
-      remoteDevice.setProtocol(rxBuffer[5]);
-      pRfIntf->ModeTech = rxBuffer[6];
-      remoteDevice.setModeTech(rxBuffer[6]);
-      remoteDevice.setInfo(pRfIntf, &rxBuffer[10]);
-      status = SUCCESS;
-    }
+    if (type == NCI_DEACTIVATE_IDLE)
+      return SUCCESS;
+
+    (void)writeData(NCIStartDiscovery, NCIStartDiscovery_length);
+    getMessage();
+    if ((rxBuffer[0] != 0x41) || (rxBuffer[1] != 0x03) ||
+        (rxBuffer[3] != 0x00))
+      return ERROR;
+    return SUCCESS;
   }
 
-  return status;
+  NCIDeactivate[3] = type;
+  (void)writeData(NCIDeactivate, sizeof(NCIDeactivate));
+  getMessage(100);
+  if ((rxBuffer[0] != 0x41) || (rxBuffer[1] != 0x06) || (rxBuffer[3] != 0x00))
+    return ERROR;
+
+  /* RF_DEACTIVATE_NTF */
+  getMessage(100);
+  if ((rxBuffer[0] != 0x61) || (rxBuffer[1] != 0x06))
+    return ERROR;
+
+  return SUCCESS;
 }
 
-bool Electroniccats_PN7150::activateNextTagDiscovery() {
-  return !Electroniccats_PN7150::ReaderActivateNext(&this->dummyRfInterface);
+uint8_t Electroniccats_PN7150::getInventoryCount() const {
+  return inventoryCount;
+}
+
+uint8_t Electroniccats_PN7150::getInventoryDropped() const {
+  return inventoryDropped;
+}
+
+const RemoteDevice *Electroniccats_PN7150::getInventoryTag(uint8_t index) const {
+  if (index >= inventoryCount)
+    return NULL;
+  return &inventory[index];
+}
+
+uint8_t Electroniccats_PN7150::getSelectedTagIndex() const {
+  return inventoryIndex;
+}
+
+bool Electroniccats_PN7150::selectTag(uint8_t index) {
+  if (index >= inventoryCount)
+    return false;
+
+  /* Already activated */
+  if ((index == inventoryIndex) &&
+      (remoteDevice.getInterface() != interface.UNDETERMINED))
+    return true;
+
+  /* Put the current tag to sleep before selecting another one */
+  if (!hostSelectPending &&
+      (deactivateTarget(NCI_DEACTIVATE_SLEEP) != SUCCESS))
+    return false;
+
+  return !selectInventoryEntry(index, &this->dummyRfInterface);
+}
+
+bool Electroniccats_PN7150::selectTag(const unsigned char *uid,
+                                      uint8_t uidLen) {
+  for (uint8_t i = 0; i < inventoryCount; i++) {
+    if ((inventory[i].getUIDLen() == uidLen) &&
+        (memcmp(inventory[i].getUID(), uid, uidLen) == 0))
+      return selectTag(i);
+  }
+  return false;
 }
 
 void Electroniccats_PN7150::readNdef(RfIntf_t RfIntf) {
   uint8_t Cmd[MAX_NCI_FRAME_SIZE];
   uint16_t CmdSize = 0;
-
-  RW_NDEF_Reset(remoteDevice.getProtocol());
+  unsigned long start = millis();
+
+  ndefStats.exchanges = 0;
+
+  /* Tag read a moment ago, serve the NDEF message without RF traffic */
+  if (repeatedTag && (ndefContext->pLastMessage != NULL) &&
+      uidCache.hasNdefCached(remoteDevice.getUID(), remoteDevice.getUIDLen())) {
+    RW_NDEF_Notify(ndefContext, ndefContext->pLastMessage,
+                   ndefContext->LastMessageSize);
+    ndefStats.bytes = ndefContext->LastMessageSize;
+    ndefStats.time = millis() - start;
+    return;
+  }
+
+  RW_NDEF_SetMaxPayload(ndefContext, remoteDevice.getMaxPayloadSize());
+  RW_NDEF_Reset(ndefContext, remoteDevice.getProtocol());
+  if (remoteDevice.getProtocol() == PROT_T2T)
+    RW_NDEF_T2T_SetFastRead(ndefContext, probeT2TFastRead());
+  /* Another tag answered the re-activation after the probe */
+  if (selectedTagSwapped)
+    return;
+  /* T3T commands carry the IDm (NFCID2) */
+  if ((remoteDevice.getProtocol() == PROT_T3T) &&
+      (remoteDevice.getUIDLen() == 8))
+    RW_NDEF_T3T_SetIDm(ndefContext, remoteDevice.getUID());
+  if ((remoteDevice.getProtocol() == PROT_ISO15693) &&
+      (remoteDevice.getUIDLen() == ISO15693_UID_SIZE))
+    RW_NDEF_T5T_SetAddressing(ndefContext, t5tAddressMode,
+                              remoteDevice.getUID());
 
   while (1) {
-    RW_NDEF_Read_Next(&rxBuffer[3], rxBuffer[2], &Cmd[3],
+    RW_NDEF_Read_Next(ndefContext, &rxBuffer[3], rxBuffer[2], &Cmd[3],
                       (unsigned short *)&CmdSize);
     if (CmdSize == 0) {
       /// End of the Read operation
       break;
+    } else if (authenticateNdefSector(&Cmd[3])) {
+      continue;
     } else {
       // Compute and send DATA_PACKET
       Cmd[0] = 0x00;
@@ -1953,6 +3110,12 @@ void Electroniccats_PN7150::readNdef(RfIntf_t RfIntf) {
       (void)writeData(Cmd, CmdSize + 3);
       getMessage();
       getMessage(1000);
+      ndefStats.exchanges++;
+      /* CORE_INTERFACE_ERROR_NTF with RF timeout status: the tag stayed
+       * silent, the NDEF engines get an empty answer */
+      if ((rxBuffer[0] == 0x60) && (rxBuffer[1] == 0x08) &&
+          (rxBuffer[3] == 0xB2))
+        rxBuffer[2] = 0;
 
       // Manage chaining in case of T4T
       if (remoteDevice.getInterface() == INTF_ISODEP && rxBuffer[0] == 0x10) {
@@ -1971,6 +3134,12 @@ void Electroniccats_PN7150::readNdef(RfIntf_t RfIntf) {
       }
     }
   }
+
+  if (uidCache.isEnabled() && (ndefContext->pLastMessage != NULL))
+    uidCache.setNdefCached(remoteDevice.getUID(), remoteDevice.getUIDLen());
+
+  ndefStats.bytes = ndefContext->LastMessageSize;
+  ndefStats.time = millis() - start;
 }
 
 void Electroniccats_PN7150::readNdefMessage(void) {
@@ -1985,15 +3154,36 @@ void Electroniccats_PN7150::ReadNdef(RfIntf_t RfIntf) {
 void Electroniccats_PN7150::writeNdef(RfIntf_t RfIntf) {
   uint8_t Cmd[MAX_NCI_FRAME_SIZE];
   uint16_t CmdSize = 0;
-
-  RW_NDEF_Reset(remoteDevice.getProtocol());
+  unsigned long start = millis();
+
+  /* The tag content is about to change */
+  uidCache.clearNdefCached();
+  ndefStats.exchanges = 0;
+  RW_NDEF_SetMaxPayload(ndefContext, remoteDevice.getMaxPayloadSize());
+  RW_NDEF_Reset(ndefContext, remoteDevice.getProtocol());
+  if ((remoteDevice.getProtocol() == PROT_T2T) && t2tSkipIdenticalPages) {
+    RW_NDEF_T2T_SetFastRead(ndefContext, probeT2TFastRead());
+    RW_NDEF_T2T_SetCompare(ndefContext, true);
+  }
+  /* Another tag answered the re-activation after the probe */
+  if (selectedTagSwapped)
+    return;
+  if ((remoteDevice.getProtocol() == PROT_T3T) &&
+      (remoteDevice.getUIDLen() == 8))
+    RW_NDEF_T3T_SetIDm(ndefContext, remoteDevice.getUID());
+  if ((remoteDevice.getProtocol() == PROT_ISO15693) &&
+      (remoteDevice.getUIDLen() == ISO15693_UID_SIZE))
+    RW_NDEF_T5T_SetAddressing(ndefContext, t5tAddressMode,
+                              remoteDevice.getUID());
 
   while (1) {
-    RW_NDEF_Write_Next(&rxBuffer[3], rxBuffer[2], &Cmd[3],
+    RW_NDEF_Write_Next(ndefContext, &rxBuffer[3], rxBuffer[2], &Cmd[3],
                        (unsigned short *)&CmdSize);
     if (CmdSize == 0) {
       // End of the Write operation
       break;
+    } else if (authenticateNdefSector(&Cmd[3])) {
+      continue;
     } else {
       // Compute and send DATA_PACKET
       Cmd[0] = 0x00;
@@ -2003,8 +3193,100 @@ void Electroniccats_PN7150::writeNdef(RfIntf_t RfIntf) {
       (void)writeData(Cmd, CmdSize + 3);
       getMessage();
       getMessage(2000);
+      ndefStats.exchanges++;
+      /* CORE_INTERFACE_ERROR_NTF with RF timeout status: the tag stayed
+       * silent, the NDEF engines get an empty answer */
+      if ((rxBuffer[0] == 0x60) && (rxBuffer[1] == 0x08) &&
+          (rxBuffer[3] == 0xB2))
+        rxBuffer[2] = 0;
     }
   }
+
+  ndefStats.bytes = ndefContext->MessageSize;
+  ndefStats.time = millis() - start;
+}
+
+const NdefStats_t *Electroniccats_PN7150::getNdefStats() const {
+  return &ndefStats;
+}
+
+/*
+ * MIFARE Classic sectors the NDEF engine authenticates are first tried with
+ * the key ring. On success the engine gets the answer of the tag as if its
+ * own command had been sent, otherwise its command is sent as a last resort
+ */
+bool Electroniccats_PN7150::authenticateNdefSector(const uint8_t *pCmd) {
+  uint32_t attempts = mifareKeyStats.attempts;
+  bool authenticated;
+
+  if ((remoteDevice.getProtocol() != PROT_MIFARE) || (pCmd[0] != 0x40))
+    return false;
+
+  authenticated = (mifareAuthenticate(pCmd[1]) == SUCCESS);
+  ndefStats.exchanges += mifareKeyStats.attempts - attempts;
+  if (!authenticated)
+    return false;
+
+  rxBuffer[0] = 0x00;
+  rxBuffer[1] = 0x00;
+  rxBuffer[2] = 2;
+  rxBuffer[3] = 0x40;
+  rxBuffer[4] = 0x00;
+  return true;
+}
+
+/*
+ * NTAG21x and MIFARE Ultralight EV1 answer GET_VERSION with NXP as vendor and
+ * support FAST_READ. Other T2T tags NAK the command and fall back to HALT, so
+ * they are activated again. The answer is kept for the last probed UID to
+ * spare the probe on repeated reads of the same tag.
+ */
+bool Electroniccats_PN7150::probeT2TFastRead() {
+  uint8_t GetVersion[] = {0x60};
+  uint8_t Answer[MAX_NCI_FRAME_SIZE];
+  uint8_t AnswerSize = 0;
+  const unsigned char *uid = remoteDevice.getUID();
+  uint8_t uidLen = remoteDevice.getUIDLen();
+
+  if (!t2tFastReadEnabled)
+    return false;
+
+  if ((uidLen != 0) && (uidLen == t2tProbedUidLen) &&
+      (memcmp(uid, t2tProbedUid, uidLen) == 0))
+    return t2tFastRead;
+
+  t2tFastRead = (readerTagCmd(GetVersion, sizeof(GetVersion), Answer,
+                              &AnswerSize) == SUCCESS) &&
+                (AnswerSize == 9) && (Answer[8] == 0x00) &&
+                (Answer[0] == 0x00) && (Answer[1] == 0x04) &&
+                ((Answer[2] == 0x03) || (Answer[2] == 0x04));
+  /* The answer of another tag must not be kept for this one */
+  if (!t2tFastRead && !reActivateSelectedTag())
+    uidLen = 0;
+
+  if (uidLen > sizeof(t2tProbedUid))
+    uidLen = 0;
+  memcpy(t2tProbedUid, uid, uidLen);
+  t2tProbedUidLen = uidLen;
+
+  return t2tFastRead;
+}
+
+void Electroniccats_PN7150::setT2TFastRead(bool enabled) {
+  t2tFastReadEnabled = enabled;
+}
+
+void Electroniccats_PN7150::setT2TSkipIdenticalPages(bool enabled) {
+  t2tSkipIdenticalPages = enabled;
+}
+
+/*
+ * Addressed requests only reach the tag being read or written when several
+ * ISO15693 tags are in the field. Selected mode sends the UID once
+ */
+void Electroniccats_PN7150::setT5TAddressMode(uint8_t mode) {
+  if (mode <= T5T_SELECTED)
+    t5tAddressMode = mode;
 }
 
 void Electroniccats_PN7150::writeNdefMessage(void) {
@@ -2119,7 +3401,19 @@ bool Electroniccats_PN7150::setP2PMode() {
 }
 
 void Electroniccats_PN7150::setReadMsgCallback(CustomCallback_t function) {
-  registerNdefReceivedCallback(function);
+  readMsgCallback = function;
+  ndefContext->pReceivedCb = function;
+}
+
+void Electroniccats_PN7150::setNdefSink(RW_NDEF_Sink_t function) {
+  RW_NDEF_RegisterSink(ndefContext, function);
+}
+
+void Electroniccats_PN7150::setNdefContext(RW_NDEF_Context_t *context) {
+  ndefContext = (context != NULL) ? context : &RW_NdefContext;
+  /* The read callback follows the reader, not the context */
+  if (readMsgCallback != NULL)
+    ndefContext->pReceivedCb = readMsgCallback;
 }
 
 void Electroniccats_PN7150::setSendMsgCallback(CustomCallback_t function) {
@@ -2144,6 +3438,22 @@ bool Electroniccats_PN7150::isReaderDetected() {
       }
       Electroniccats_PN7150::closeCommunication();
     }
+  } else if ((rxMessageLength != 0) && (rxBuffer[0] == 0x61) &&
+             (rxBuffer[1] == 0x05) &&
+             ((rxBuffer[6] & MODE_LISTEN) == MODE_LISTEN)) {
+    /* RF_INTF_ACTIVATED_NTF in listen mode: a reader field is activating us */
+    this->dummyRfInterface.Interface = rxBuffer[4];
+    remoteDevice.setInterface(rxBuffer[4]);
+    this->dummyRfInterface.Protocol = rxBuffer[5];
+    remoteDevice.setProtocol(rxBuffer[5]);
+    this->dummyRfInterface.ModeTech = rxBuffer[6];
+    remoteDevice.setModeTech(rxBuffer[6]);
+    this->dummyRfInterface.MoreTags = false;
+    remoteDevice.setMoreTagsAvailable(false);
+    remoteDevice.setDiscoveryId(rxBuffer[3]);
+    remoteDevice.setMaxPayloadSize(rxBuffer[7]);
+    remoteDevice.setInfo(&this->dummyRfInterface, &rxBuffer[10]);
+    notifyTagArrived();
   }
 
   return status;
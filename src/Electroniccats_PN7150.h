@@ -21,12 +21,16 @@
 #include <Arduino.h> // Gives us access to all typical Arduino types and functions
 // The HW interface between The PN7150 and the DeviceHost is I2C, so we need the
 // I2C library.library
+#include "DiscoveryFilter.h"
+#include "MifareKeyRing.h"
 #include "Mode.h"
 #include "NdefMessage.h"
 #include "NdefRecord.h"
 #include "P2P_NDEF.h"
 #include "RemoteDevice.h"
 #include "T4T_NDEF_emu.h"
+#include "TagEventQueue.h"
+#include "UidCache.h"
 
 #if defined(TEENSYDUINO) &&                                                    \
     defined(KINETISK) // Teensy 3.0, 3.1, 3.2, 3.5, 3.6 :  Special, more
@@ -66,8 +70,101 @@
 #define MaxPayloadSize 255 // See NCI specification V1.0, section 3.1
 #define MsgHeaderSize 3
 
+/*
+ * Maximum number of targets kept from RF_DISCOVER_NTF notifications
+ */
+#ifndef NFC_MAX_INVENTORY_SIZE
+#define NFC_MAX_INVENTORY_SIZE 8
+#endif
+
+/*
+ * RF_DEACTIVATE_CMD deactivation types, see NCI specification V1.0, table 63
+ */
+#define NCI_DEACTIVATE_IDLE 0x00
+#define NCI_DEACTIVATE_SLEEP 0x01
+#define NCI_DEACTIVATE_SLEEP_AF 0x02
+#define NCI_DEACTIVATE_DISCOVERY 0x03
+
+/*
+ * ISO15693 bulk inventory, see ISO/IEC 15693-3 section 8
+ */
+#ifndef ISO15693_MAX_INVENTORY_ROUNDS
+#define ISO15693_MAX_INVENTORY_ROUNDS 16
+#endif
+#define ISO15693_UID_SIZE 8
+
+/*
+ * Continuous scan mode, tags not seen for the removal timeout are reported as
+ * removed
+ */
+#ifndef CONTINUOUS_SCAN_MAX_TAGS
+#define CONTINUOUS_SCAN_MAX_TAGS 8
+#endif
+#define CONTINUOUS_SCAN_REMOVAL_TIMEOUT 500 // ms
+
+/*
+ * TAG_DETECTOR_CFG bits, low power card detection, see PN7150 User Manual
+ */
+#define TAG_DETECTOR_ENABLE 0x01
+#define TAG_DETECTOR_TRACE 0x02 // Report detector wake ups to the host
+#ifndef TAG_DETECTOR_TRACE_OID
+#define TAG_DETECTOR_TRACE_OID 0x0C // Proprietary NTF sent on each wake up
+#endif
+
+/*
+ * Presence check, one interval per protocol (T1T to ISO15693 and MIFARE)
+ */
+#define PRESENCE_CHECK_PROTOCOLS 8
+#define PRESENCE_CHECK_INTERVAL 500 // ms
+#define PRESENCE_ADAPTIVE_DIVISOR 4 // Interval as a fraction of the dwell time
+
+/*
+ * MIFARE Classic presence check strategies
+ */
+#define MIFARE_PRESENCE_RESELECT 0   // Deactivate and select again
+#define MIFARE_PRESENCE_READ_BLOCK 1 // Read the last authenticated block
+#define MIFARE_NO_SECTOR 0xFF
+
+/*
+ * MIFARE Classic bulk read and write. Sectors 32 to 39 of 4K cards have 16
+ * blocks, the others 4, the last one being the sector trailer
+ */
+#define MIFARE_BLOCK_SIZE 16
+#define MIFARE_MAX_SECTORS 40
+#define MIFARE_BLOCK_OK 0
+#define MIFARE_BLOCK_AUTH_ERROR 1 // No key of the key ring accepted
+#define MIFARE_BLOCK_ERROR 2      // Block refused by the tag
+
+/*
+ * ISO15693 (T5T) NDEF request addressing
+ */
+#define T5T_NON_ADDRESSED 0 // Any tag in the field answers
+#define T5T_ADDRESSED 1     // Requests carry the tag UID
+#define T5T_SELECTED 2      // Tag selected first, then the select flag
+
 enum ChipModel { PN7150 = 0, PN7160 = 1 };
 
+/*
+ * Tag found during an ISO15693 inventory, the UID is stored MSB first (same
+ * order as RemoteDevice::getID())
+ */
+typedef struct {
+  unsigned char uid[ISO15693_UID_SIZE];
+  unsigned char dsfid;
+} ISO15693Tag_t;
+
+/*
+ * Statistics of the last ISO15693 inventory. A round is one 16 slots sweep
+ * for a given mask, only the first ISO15693_MAX_INVENTORY_ROUNDS are timed
+ */
+typedef struct {
+  uint8_t rounds;
+  uint16_t collisions;
+  uint8_t dropped;
+  unsigned long roundTime[ISO15693_MAX_INVENTORY_ROUNDS]; // ms
+  unsigned long totalTime;                                // ms
+} ISO15693InventoryStats_t;
+
 /***** Factory Test dedicated APIs
  * *********************************************/
 #ifdef NFC_FACTORY_TEST
@@ -83,6 +180,67 @@ typedef enum { NFC_A, NFC_B, NFC_F } NxpNci_TechType_t;
 typedef enum { BR_106, BR_212, BR_424, BR_848 } NxpNci_Bitrate_t;
 #endif
 
+/*
+ * Tag detector wake ups, only reported when the trace mode is enabled. A wake
+ * up not followed by a tag detection is a false wake
+ */
+typedef struct {
+  uint32_t wakes;
+  uint32_t detections;
+  uint32_t falseWakes;
+} TagDetectorStats_t;
+
+/*
+ * Time spent by the presence checks of one strategy, in microseconds
+ */
+typedef struct {
+  uint32_t checks;
+  unsigned long totalTime;
+  unsigned long lastTime;
+} PresenceCheckStats_t;
+
+/*
+ * Presence monitoring figures, times in milliseconds. The removal latency is
+ * the worst case, the time since the last check that still saw the tag
+ */
+typedef struct {
+  uint32_t checks;
+  uint32_t totalChecks;
+  unsigned long dwellTime;
+  unsigned long removalLatency;
+  unsigned long maxRemovalLatency;
+} PresenceStats_t;
+
+/*
+ * Cost of the last NDEF read or write, the time is in milliseconds
+ */
+typedef struct {
+  uint16_t exchanges;
+  uint16_t bytes;
+  unsigned long time;
+} NdefStats_t;
+
+/*
+ * Callback receiving the properties of a tag or reader, the reference stays
+ * valid until the next event of the same kind
+ */
+typedef void TagCallback_t(const RfIntfCC_t &remoteDevice);
+
+/*
+ * Callback receiving the UID of each new tag in UID only mode
+ */
+typedef void UidCallback_t(const unsigned char *uid, uint8_t uidLen);
+
+/*
+ * Tag present in the field while running the continuous scan mode
+ */
+typedef struct {
+  unsigned char uid[TAG_EVENT_MAX_UID_SIZE];
+  uint8_t uidLen;
+  bool arrived; // onTagArrived() fired, onTagRemoved() is owed
+  unsigned long lastSeen;
+} ScanTag_t;
+
 /*
  * Definition of operations handled when processing Reader mode
  */
@@ -109,6 +267,68 @@ private:
   uint32_t
       rxMessageLength; // length of the last message received. As these are not
                        // 0x00 terminated, we need to remember the length
+  RemoteDevice inventory[NFC_MAX_INVENTORY_SIZE];
+  uint8_t inventoryCount = 0;
+  uint8_t inventoryIndex = 0;
+  uint8_t inventoryDropped = 0;
+  bool hostSelectPending = false; // Targets discovered, none activated yet
+  DiscoveryFilter discoveryFilter;
+  uint32_t filteredTagCount = 0;
+  UidCache uidCache;
+  uint8_t uidCacheMode = UID_CACHE_SHORT_CIRCUIT;
+  bool repeatedTag = false;
+  TagEventQueue tagEvents;
+  ScanTag_t scanTags[CONTINUOUS_SCAN_MAX_TAGS];
+  uint8_t scanTagCount = 0;
+  RfIntfCC_t scanTagIntf[CONTINUOUS_SCAN_MAX_TAGS]; // Given to the callbacks
+  ScanTag_t droppedScanTags[CONTINUOUS_SCAN_MAX_TAGS]; // Seen, table full
+  uint8_t droppedScanTagCount = 0;
+  bool continuousScan = false;
+  bool continuousScanNdef = false;
+  unsigned long scanRemovalTimeout = CONTINUOUS_SCAN_REMOVAL_TIMEOUT;
+  bool uidOnlyMode = false;
+  uint32_t uidOnlyTagCount = 0;
+  unsigned long uidOnlyStartTime = 0;
+  UidCallback_t *uidCallback = NULL;
+  RemoteDevice arrivedTag;
+  RemoteDevice readerDevice;
+  bool tagArrived = false;
+  TagCallback_t *tagArrivedCallback = NULL;
+  TagCallback_t *tagRemovedCallback = NULL;
+  TagCallback_t *readerFieldCallback = NULL;
+  uint16_t presenceCheckInterval[PRESENCE_CHECK_PROTOCOLS] = {
+      PRESENCE_CHECK_INTERVAL, PRESENCE_CHECK_INTERVAL,
+      PRESENCE_CHECK_INTERVAL, PRESENCE_CHECK_INTERVAL,
+      PRESENCE_CHECK_INTERVAL, PRESENCE_CHECK_INTERVAL,
+      PRESENCE_CHECK_INTERVAL, PRESENCE_CHECK_INTERVAL};
+  bool presenceMonitoring = false;
+  uint8_t mifarePresenceStrategy = MIFARE_PRESENCE_RESELECT;
+  uint8_t mifareAuthSector = MIFARE_NO_SECTOR;
+  PresenceCheckStats_t mifarePresenceStats[2] = {};
+  MifareKeyRing mifareKeys;
+  MifareKeyStats_t mifareKeyStats = {};
+  bool selectedTagSwapped = false; // Re-activation reached another tag
+  unsigned long nextPresenceCheck = 0;
+  unsigned long presenceStartTime = 0;
+  unsigned long lastTagPresent = 0;
+  uint16_t adaptiveMinInterval = 0;
+  uint16_t adaptiveMaxInterval = 0;
+  PresenceStats_t presenceStats = {};
+  RW_NDEF_Context_t *ndefContext = &RW_NdefContext;
+  CustomCallback_t *readMsgCallback = NULL;
+  NdefStats_t ndefStats = {};
+  bool t2tFastReadEnabled = true;
+  bool t2tFastRead = false;
+  bool t2tSkipIdenticalPages = false;
+  unsigned char t2tProbedUid[10];
+  uint8_t t2tProbedUidLen = 0;
+  uint8_t t5tAddressMode = T5T_NON_ADDRESSED;
+  uint8_t tagDetectorCfg = 0x00;
+  uint8_t tagDetectorThreshold = 0x04;
+  uint8_t tagDetectorFallback = 0x00;
+  bool standbyEnabled = true;
+  TagDetectorStats_t tagDetectorStats = {};
+  bool tagDetectorWakePending = false;
   uint8_t gNfcController_generation = 0;
   uint8_t gNfcController_fw_version[3] = {0};
   void
@@ -119,6 +339,37 @@ private:
   bool
   getMessage(uint16_t timeout =
                  5); // 5 miliseconds as default to wait for interrupt responses
+  void addInventoryEntry();
+  uint8_t selectInventoryEntry(uint8_t index, RfIntf_t *pRfIntf);
+  uint8_t deactivateTarget(uint8_t type);
+  void countTagDetectorWake();
+  void notifyTagArrived();
+  void notifyTagRemoved();
+  uint8_t presenceIntervalIndex(uint8_t protocol);
+  void startPresenceMonitoring();
+  uint16_t presenceInterval();
+  bool trackTagPresence();
+  bool checkMifarePresence();
+  bool reActivateSelectedTag();
+  bool tryMifareKey(uint8_t index, uint8_t sector);
+  uint16_t transferMifareSectors(uint8_t first, uint8_t count,
+                                 unsigned char *data, uint8_t *blockStatus,
+                                 bool trailers, bool write);
+  bool authenticateNdefSector(const uint8_t *pCmd);
+  bool probeT2TFastRead();
+  uint8_t writeTagDetectorSettings();
+  bool applyTagDetectorSettings();
+  ISO15693InventoryStats_t iso15693Stats = {};
+  uint8_t iso15693InventorySlot(const uint8_t *mask, uint8_t maskLen,
+                                bool useAfi, uint8_t afi, ISO15693Tag_t *pTag);
+  void iso15693InventoryRound(uint8_t *mask, uint8_t maskLen, bool useAfi,
+                              uint8_t afi, ISO15693Tag_t *tags, uint8_t maxTags,
+                              uint8_t *pCount);
+  int8_t trackScanTag(const RemoteDevice *pTag, unsigned long now);
+  void pushTagEvent(uint8_t type, const RemoteDevice *pTag,
+                    unsigned short ndefSize);
+  uint8_t iso15693Inventory(ISO15693Tag_t *tags, uint8_t maxTags, bool useAfi,
+                            uint8_t afi);
 
 public:
   Electroniccats_PN7150(uint8_t IRQpin, uint8_t VENpin, uint8_t I2Caddress,
@@ -153,6 +404,11 @@ public:
   bool ConfigureSettings(
       uint8_t *nfcuid,
       uint8_t uidlen); // Deprecated, use configureSettings() instead
+  bool setTagDetector(bool enable, uint8_t threshold = 0x04,
+                      uint8_t fallbackCount = 0x00, bool trace = false);
+  bool setStandby(bool enable);
+  const TagDetectorStats_t *getTagDetectorStats() const;
+  void clearTagDetectorStats();
   uint8_t startDiscovery();
   uint8_t
   StartDiscovery(uint8_t modeSE); // Deprecated, use startDiscovery() instead
@@ -162,6 +418,31 @@ public:
       RfIntf_t *pRfIntf,
       uint16_t tout = 0); // Deprecated, use isTagDetected() instead
   bool isTagDetected(uint16_t tout = 500);
+  bool addDiscoveryFilter(const DiscoveryFilterRule_t *rule);
+  void clearDiscoveryFilters();
+  uint32_t getFilteredTagCount() const;
+  void startContinuousScan(
+      bool readNdef = false,
+      unsigned long removalTimeout = CONTINUOUS_SCAN_REMOVAL_TIMEOUT);
+  void stopContinuousScan();
+  bool isContinuousScanRunning() const;
+  void handleContinuousScan(uint16_t tout = 10);
+  bool startUidLogging();
+  bool stopUidLogging();
+  bool isUidLoggingRunning() const;
+  void setUidCallback(UidCallback_t function);
+  uint32_t getLoggedTagCount() const;
+  float getTagsPerSecond() const;
+  bool getTagEvent(TagEvent_t *event);
+  uint8_t getTagEventCount() const;
+  uint16_t getDroppedTagEvents() const;
+  void onTagArrived(TagCallback_t function);
+  void onTagRemoved(TagCallback_t function);
+  void onReaderField(TagCallback_t function);
+  void setUidCacheHoldOff(unsigned long holdOff);
+  void setUidCacheMode(uint8_t mode);
+  bool isRepeatedTag() const;
+  void clearUidCache();
   bool cardModeSend(unsigned char *pData, unsigned char DataSize);
   bool CardModeSend(
       unsigned char *pData,
@@ -189,18 +470,50 @@ public:
   void
   PresenceCheck(RfIntf_t RfIntf); // Deprecated, use waitForTagRemoval() instead
   void waitForTagRemoval();
+  bool checkTagPresence();
+  bool isTagRemoved();
+  void setPresenceCheckInterval(uint16_t interval);
+  void setPresenceCheckInterval(uint8_t protocol, uint16_t interval);
+  uint16_t getPresenceCheckInterval(uint8_t protocol);
+  void setAdaptivePresenceCheck(uint16_t minInterval, uint16_t maxInterval);
+  const PresenceStats_t *getPresenceStats() const;
+  void clearPresenceStats();
+  void setMifarePresenceCheck(uint8_t strategy);
+  const PresenceCheckStats_t *getMifarePresenceStats(uint8_t strategy) const;
   bool readerTagCmd(unsigned char *pCommand, unsigned char CommandSize,
                     unsigned char *pAnswer, unsigned char *pAnswerSize);
+  bool addMifareKey(const unsigned char *key, uint8_t keyType = MIFARE_KEY_A,
+                    uint8_t sector = MIFARE_ALL_SECTORS);
+  void clearMifareKeys();
+  bool mifareAuthenticate(uint8_t sector);
+  const MifareKeyStats_t *getMifareKeyStats() const;
+  void clearMifareKeyStats();
+  uint16_t getMifareSectorBlocks(uint8_t first, uint8_t count,
+                                 bool trailers = false) const;
+  uint16_t readMifareSectors(uint8_t first, uint8_t count, unsigned char *data,
+                             uint8_t *blockStatus, bool trailers = false);
+  uint16_t writeMifareSectors(uint8_t first, uint8_t count,
+                              const unsigned char *data, uint8_t *blockStatus,
+                              bool trailers = false);
   bool ReaderTagCmd(
       unsigned char *pCommand, unsigned char CommandSize,
       unsigned char *pAnswer,
       unsigned char *pAnswerSize); // Deprecated, use readerTagCmd() instead
+  uint8_t inventoryISO15693(ISO15693Tag_t *tags, uint8_t maxTags);
+  uint8_t inventoryISO15693(ISO15693Tag_t *tags, uint8_t maxTags, uint8_t afi);
+  const ISO15693InventoryStats_t *getISO15693InventoryStats() const;
   bool readerReActivate();
   bool ReaderReActivate(
       RfIntf_t *pRfIntf); // Deprecated, use readerReActivate() instead
   bool activateNextTagDiscovery();
   bool ReaderActivateNext(
       RfIntf_t *pRfIntf); // Deprecated, use activateNextTagDiscovery() instead
+  uint8_t getInventoryCount() const;
+  uint8_t getInventoryDropped() const;
+  const RemoteDevice *getInventoryTag(uint8_t index) const;
+  uint8_t getSelectedTagIndex() const;
+  bool selectTag(uint8_t index);
+  bool selectTag(const unsigned char *uid, uint8_t uidLen);
   void readNdef(RfIntf_t RfIntf); // TODO: remove it
   void readNdefMessage();
   void ReadNdef(RfIntf_t RfIntf);  // Deprecated, use readNdefMessage() instead
@@ -216,6 +529,12 @@ public:
   NxpNci_FactoryTest_RfOn(); // Deprecated, use nciFactoryTestRfOn() instead
   bool reset();
   void setReadMsgCallback(CustomCallback_t function);
+  void setNdefSink(RW_NDEF_Sink_t function);
+  void setNdefContext(RW_NDEF_Context_t *context);
+  const NdefStats_t *getNdefStats() const;
+  void setT2TFastRead(bool enabled);
+  void setT2TSkipIdenticalPages(bool enabled);
+  void setT5TAddressMode(uint8_t mode);
   void setSendMsgCallback(CustomCallback_t function);
   bool isReaderDetected();
   void closeCommunication();
@@ -0,0 +1,129 @@
+/**
+ * Library to authenticate MIFARE Classic sectors with a list of keys
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "MifareKeyRing.h"
+
+MifareKeyRing::MifareKeyRing() {
+  this->useCount = 0;
+  clearKeys();
+}
+
+/*
+ * Keys are tried in the order they were added, a key added for
+ * MIFARE_ALL_SECTORS is tried on every sector
+ */
+bool MifareKeyRing::addKey(const unsigned char *key, uint8_t type,
+                           uint8_t sector) {
+  if ((keyCount == MIFARE_KEY_RING_SIZE) ||
+      ((type != MIFARE_KEY_A) && (type != MIFARE_KEY_B)))
+    return false;
+
+  memcpy(keys[keyCount].value, key, MIFARE_KEY_SIZE);
+  keys[keyCount].type = type;
+  keys[keyCount].sector = sector;
+  keyCount++;
+  return true;
+}
+
+/*
+ * The cache refers to the keys by position, so it goes with them
+ */
+void MifareKeyRing::clearKeys() {
+  keyCount = 0;
+  clearCache();
+}
+
+uint8_t MifareKeyRing::getKeyCount() const { return keyCount; }
+
+bool MifareKeyRing::isKeyFor(uint8_t index, uint8_t sector) const {
+  return (index < keyCount) && ((keys[index].sector == MIFARE_ALL_SECTORS) ||
+                                (keys[index].sector == sector));
+}
+
+/*
+ * MFC_AUTHENTICATE tag command with the key embedded, returns its size
+ */
+uint8_t MifareKeyRing::authCommand(uint8_t index, uint8_t sector,
+                                   unsigned char *pCmd) const {
+  pCmd[0] = 0x40;
+  pCmd[1] = sector;
+  pCmd[2] = 0x10 | keys[index].type;
+  memcpy(&pCmd[3], keys[index].value, MIFARE_KEY_SIZE);
+  return MIFARE_AUTH_CMD_SIZE;
+}
+
+MifareKeyRing::Entry *MifareKeyRing::find(const unsigned char *uid,
+                                          uint8_t uidLen, uint8_t sector) {
+  if ((uidLen == 0) || (uidLen > MIFARE_KEY_CACHE_MAX_UID_SIZE))
+    return NULL;
+
+  for (uint8_t i = 0; i < MIFARE_KEY_CACHE_SIZE; i++) {
+    if ((entries[i].uidLen == uidLen) && (entries[i].sector == sector) &&
+        (memcmp(entries[i].uid, uid, uidLen) == 0))
+      return &entries[i];
+  }
+  return NULL;
+}
+
+int8_t MifareKeyRing::getCachedKey(const unsigned char *uid, uint8_t uidLen,
+                                   uint8_t sector) {
+  Entry *entry = find(uid, uidLen, sector);
+
+  if (entry == NULL)
+    return MIFARE_NO_KEY;
+  entry->lastUsed = ++useCount;
+  return entry->key;
+}
+
+/*
+ * Unknown UID and sector pairs replace the least recently used entry
+ */
+void MifareKeyRing::setCachedKey(const unsigned char *uid, uint8_t uidLen,
+                                 uint8_t sector, uint8_t index) {
+  Entry *entry = find(uid, uidLen, sector);
+
+  if ((uidLen == 0) || (uidLen > MIFARE_KEY_CACHE_MAX_UID_SIZE))
+    return;
+
+  if (entry == NULL) {
+    entry = &entries[0];
+    for (uint8_t i = 0; i < MIFARE_KEY_CACHE_SIZE; i++) {
+      if (entries[i].uidLen == 0) {
+        entry = &entries[i];
+        break;
+      }
+      if ((uint16_t)(useCount - entries[i].lastUsed) >
+          (uint16_t)(useCount - entry->lastUsed))
+        entry = &entries[i];
+    }
+    memcpy(entry->uid, uid, uidLen);
+    entry->uidLen = uidLen;
+    entry->sector = sector;
+  }
+
+  entry->key = index;
+  entry->lastUsed = ++useCount;
+}
+
+void MifareKeyRing::forgetCachedKey(const unsigned char *uid, uint8_t uidLen,
+                                    uint8_t sector) {
+  Entry *entry = find(uid, uidLen, sector);
+
+  if (entry != NULL)
+    entry->uidLen = 0;
+}
+
+void MifareKeyRing::clearCache() {
+  for (uint8_t i = 0; i < MIFARE_KEY_CACHE_SIZE; i++) {
+    entries[i].uidLen = 0;
+    entries[i].lastUsed = 0;
+  }
+}
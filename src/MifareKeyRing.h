@@ -0,0 +1,83 @@
+/**
+ * Library to authenticate MIFARE Classic sectors with a list of keys
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef MifareKeyRing_H
+#define MifareKeyRing_H
+
+#include "Arduino.h"
+
+#ifndef MIFARE_KEY_RING_SIZE
+#define MIFARE_KEY_RING_SIZE 8
+#endif
+#ifndef MIFARE_KEY_CACHE_SIZE
+#define MIFARE_KEY_CACHE_SIZE 16
+#endif
+#define MIFARE_KEY_CACHE_MAX_UID_SIZE 7
+#define MIFARE_KEY_SIZE 6
+#define MIFARE_AUTH_CMD_SIZE (3 + MIFARE_KEY_SIZE)
+
+/*
+ * Key types, as the key selector bit of the authentication command
+ */
+#define MIFARE_KEY_A 0x00
+#define MIFARE_KEY_B 0x80
+
+#define MIFARE_ALL_SECTORS 0xFF
+#define MIFARE_NO_KEY -1
+
+/*
+ * A hit is a sector authenticated by its cached key on the first attempt, a
+ * miss one with no cached key or whose cached key was refused
+ */
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t attempts; // Authentication commands sent
+  uint32_t failures; // Sectors no key of the ring could authenticate
+} MifareKeyStats_t;
+
+class MifareKeyRing {
+private:
+  struct Key {
+    unsigned char value[MIFARE_KEY_SIZE];
+    uint8_t type;
+    uint8_t sector;
+  };
+  struct Entry {
+    unsigned char uid[MIFARE_KEY_CACHE_MAX_UID_SIZE];
+    uint8_t uidLen;
+    uint8_t sector;
+    uint8_t key;
+    uint16_t lastUsed;
+  };
+  Key keys[MIFARE_KEY_RING_SIZE];
+  uint8_t keyCount;
+  Entry entries[MIFARE_KEY_CACHE_SIZE];
+  uint16_t useCount;
+  Entry *find(const unsigned char *uid, uint8_t uidLen, uint8_t sector);
+
+public:
+  MifareKeyRing();
+  bool addKey(const unsigned char *key, uint8_t type, uint8_t sector);
+  void clearKeys();
+  uint8_t getKeyCount() const;
+  bool isKeyFor(uint8_t index, uint8_t sector) const;
+  uint8_t authCommand(uint8_t index, uint8_t sector, unsigned char *pCmd) const;
+  int8_t getCachedKey(const unsigned char *uid, uint8_t uidLen,
+                      uint8_t sector);
+  void setCachedKey(const unsigned char *uid, uint8_t uidLen, uint8_t sector,
+                    uint8_t index);
+  void forgetCachedKey(const unsigned char *uid, uint8_t uidLen,
+                       uint8_t sector);
+  void clearCache();
+};
+
+#endif
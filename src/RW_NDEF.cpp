@@ -19,40 +19,85 @@
 #include "RW_NDEF_T2T.h"
 #include "RW_NDEF_T3T.h"
 #include "RW_NDEF_T4T.h"
+#include "RW_NDEF_T5T.h"
 
+#ifndef RW_NDEF_NO_STATIC_BUFFER
 /* Allocate buffer for NDEF operations */
 unsigned char NdefBuffer[RW_MAX_NDEF_FILE_SIZE];
 
-typedef void RW_NDEF_Fct_t(unsigned char *pCmd, unsigned short Cmd_size,
-                           unsigned char *Rsp, unsigned short *pRsp_size);
+RW_NDEF_Context_t RW_NdefContext =
+    RW_NDEF_CONTEXT_INIT(NdefBuffer, RW_MAX_NDEF_FILE_SIZE);
+#else
+RW_NDEF_Context_t RW_NdefContext = RW_NDEF_CONTEXT_INIT(NULL, 0);
+#endif
 
-unsigned char *pRW_NdefMessage;
-unsigned short RW_NdefMessage_size;
-
-RW_NDEF_Callback_t *pRW_NDEF_PullCb;
-RW_NDEF_Callback_t *pRW_NDEF_PushCb;
 RW_NDEF_Callback_t *updateNdefMessageCallback;
-CustomCallback_t *ndefReceivedCallback;
 
-static RW_NDEF_Fct_t *pReadFct = NULL;
-static RW_NDEF_Fct_t *pWriteFct = NULL;
+void RW_NDEF_InitContext(RW_NDEF_Context_t *pCtx, unsigned char *pBuffer,
+                         unsigned short Buffer_size) {
+  memset(pCtx, 0, sizeof(RW_NDEF_Context_t));
+  pCtx->pBuffer = pBuffer;
+  pCtx->BufferSize = Buffer_size;
+}
 
-bool RW_NDEF_SetMessage(unsigned char *pMessage, unsigned short Message_size,
-                        void *pCb) {
-  if (Message_size <= RW_MAX_NDEF_FILE_SIZE) {
-    pRW_NdefMessage = pMessage;
-    RW_NdefMessage_size = Message_size;
-    pRW_NDEF_PushCb = (RW_NDEF_Callback_t *)pCb;
-    return true;
-  } else {
-    RW_NdefMessage_size = 0;
-    pRW_NDEF_PushCb = NULL;
-    return false;
+bool RW_NDEF_SetMessage(RW_NDEF_Context_t *pCtx, unsigned char *pMessage,
+                        unsigned short Message_size, void *pCb) {
+  pCtx->pMessage = pMessage;
+  pCtx->MessageSize = Message_size;
+  pCtx->pPushCb = (RW_NDEF_Callback_t *)pCb;
+  return true;
+}
+
+void RW_NDEF_RegisterPullCallback(RW_NDEF_Context_t *pCtx, void *pCb) {
+  pCtx->pPullCb = (RW_NDEF_Callback_t *)pCb;
+}
+
+/* With a sink the read messages are streamed, the buffer does not cap them */
+void RW_NDEF_RegisterSink(RW_NDEF_Context_t *pCtx, RW_NDEF_Sink_t *pSink) {
+  pCtx->pSink = pSink;
+}
+
+/* Commands and responses are sized to fit in one data packet */
+void RW_NDEF_SetMaxPayload(RW_NDEF_Context_t *pCtx, unsigned char MaxPayload) {
+  pCtx->MaxPayload = MaxPayload;
+}
+
+/* Notify the application of the NDEF reception, pMessage is NULL on error */
+void RW_NDEF_Notify(RW_NDEF_Context_t *pCtx, unsigned char *pMessage,
+                    unsigned short Message_size) {
+  /* Streamed message, already delivered to the sink and not in the buffer */
+  if ((pCtx->pSink != NULL) && (pMessage != NULL)) {
+    pCtx->pLastMessage = NULL;
+    pCtx->LastMessageSize = 0;
+    if (pCtx->pReceivedCb != NULL)
+      pCtx->pReceivedCb();
+    return;
   }
+
+  pCtx->pLastMessage = pMessage;
+  pCtx->LastMessageSize = Message_size;
+
+  if (pCtx->pPullCb != NULL)
+    pCtx->pPullCb(pMessage, Message_size);
+
+  if (updateNdefMessageCallback != NULL)
+    updateNdefMessageCallback(pMessage, Message_size);
+
+  if (pCtx->pReceivedCb != NULL)
+    pCtx->pReceivedCb();
 }
 
-void RW_NDEF_RegisterPullCallback(void *pCb) {
-  pRW_NDEF_PullCb = (RW_NDEF_Callback_t *)pCb;
+bool RW_NDEF_Fits(RW_NDEF_Context_t *pCtx, unsigned short Message_size) {
+  return (pCtx->pSink != NULL) || (Message_size <= pCtx->BufferSize);
+}
+
+void RW_NDEF_Store(RW_NDEF_Context_t *pCtx, unsigned short Offset,
+                   unsigned char *pChunk, unsigned short Chunk_size,
+                   unsigned short Message_size) {
+  if (pCtx->pSink != NULL)
+    pCtx->pSink(pChunk, Chunk_size, Offset, Message_size);
+  else
+    memcpy(&pCtx->pBuffer[Offset], pChunk, Chunk_size);
 }
 
 void registerUpdateNdefMessageCallback(RW_NDEF_Callback_t function) {
@@ -60,50 +105,116 @@ void registerUpdateNdefMessageCallback(RW_NDEF_Callback_t function) {
 }
 
 void registerNdefReceivedCallback(CustomCallback_t function) {
-  ndefReceivedCallback = function;
+  RW_NdefContext.pReceivedCb = function;
 }
 
-void RW_NDEF_Reset(unsigned char type) {
-  pReadFct = NULL;
-  pWriteFct = NULL;
+void RW_NDEF_Reset(RW_NDEF_Context_t *pCtx, unsigned char type) {
+  pCtx->Type = type;
+  pCtx->pLastMessage = NULL;
+  pCtx->LastMessageSize = 0;
 
   switch (type) {
   case RW_NDEF_TYPE_T1T:
-    RW_NDEF_T1T_Reset();
-    pReadFct = RW_NDEF_T1T_Read_Next;
+    RW_NDEF_T1T_Reset(pCtx);
+    break;
+  case RW_NDEF_TYPE_T2T:
+    RW_NDEF_T2T_Reset(pCtx);
+    break;
+  case RW_NDEF_TYPE_T3T:
+    RW_NDEF_T3T_Reset(pCtx);
+    break;
+  case RW_NDEF_TYPE_T4T:
+    RW_NDEF_T4T_Reset(pCtx);
+    break;
+  case RW_NDEF_TYPE_T5T:
+    RW_NDEF_T5T_Reset(pCtx);
+    break;
+  case RW_NDEF_TYPE_MIFARE:
+    RW_NDEF_MIFARE_Reset(pCtx);
+    break;
+  default:
+    break;
+  }
+}
+
+void RW_NDEF_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                       unsigned short Cmd_size, unsigned char *Rsp,
+                       unsigned short *pRsp_size) {
+  switch (pCtx->Type) {
+  case RW_NDEF_TYPE_T1T:
+    RW_NDEF_T1T_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
     break;
   case RW_NDEF_TYPE_T2T:
-    RW_NDEF_T2T_Reset();
-    pReadFct = RW_NDEF_T2T_Read_Next;
-    pWriteFct = RW_NDEF_T2T_Write_Next;
+    RW_NDEF_T2T_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
     break;
   case RW_NDEF_TYPE_T3T:
-    RW_NDEF_T3T_Reset();
-    pReadFct = RW_NDEF_T3T_Read_Next;
+    RW_NDEF_T3T_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
     break;
   case RW_NDEF_TYPE_T4T:
-    RW_NDEF_T4T_Reset();
-    pReadFct = RW_NDEF_T4T_Read_Next;
-    pWriteFct = RW_NDEF_T4T_Write_Next;
+    RW_NDEF_T4T_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_T5T:
+    RW_NDEF_T5T_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
     break;
   case RW_NDEF_TYPE_MIFARE:
-    RW_NDEF_MIFARE_Reset();
-    pReadFct = RW_NDEF_MIFARE_Read_Next;
-    pWriteFct = RW_NDEF_MIFARE_Write_Next;
+    RW_NDEF_MIFARE_Read_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
     break;
   default:
+    *pRsp_size = 0;
     break;
   }
 }
 
+void RW_NDEF_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                        unsigned short Cmd_size, unsigned char *Rsp,
+                        unsigned short *pRsp_size) {
+  switch (pCtx->Type) {
+  case RW_NDEF_TYPE_T1T:
+    RW_NDEF_T1T_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_T2T:
+    RW_NDEF_T2T_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_T3T:
+    RW_NDEF_T3T_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_T4T:
+    RW_NDEF_T4T_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_T5T:
+    RW_NDEF_T5T_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  case RW_NDEF_TYPE_MIFARE:
+    RW_NDEF_MIFARE_Write_Next(pCtx, pCmd, Cmd_size, Rsp, pRsp_size);
+    break;
+  default:
+    *pRsp_size = 0;
+    break;
+  }
+}
+
+/* Legacy entry points, working on RW_NdefContext */
+void RW_NDEF_Reset(unsigned char type) { RW_NDEF_Reset(&RW_NdefContext, type); }
+
 void RW_NDEF_Read_Next(unsigned char *pCmd, unsigned short Cmd_size,
                        unsigned char *Rsp, unsigned short *pRsp_size) {
-  if (pReadFct != NULL)
-    pReadFct(pCmd, Cmd_size, Rsp, pRsp_size);
+  RW_NDEF_Read_Next(&RW_NdefContext, pCmd, Cmd_size, Rsp, pRsp_size);
 }
 
 void RW_NDEF_Write_Next(unsigned char *pCmd, unsigned short Cmd_size,
                         unsigned char *Rsp, unsigned short *pRsp_size) {
-  if (pWriteFct != NULL)
-    pWriteFct(pCmd, Cmd_size, Rsp, pRsp_size);
+  RW_NDEF_Write_Next(&RW_NdefContext, pCmd, Cmd_size, Rsp, pRsp_size);
+}
+
+bool RW_NDEF_SetMessage(unsigned char *pMessage, unsigned short Message_size,
+                        void *pCb) {
+  return RW_NDEF_SetMessage(&RW_NdefContext, pMessage, Message_size, pCb);
+}
+
+void RW_NDEF_RegisterPullCallback(void *pCb) {
+  RW_NDEF_RegisterPullCallback(&RW_NdefContext, pCb);
+}
+
+void RW_NDEF_RegisterSink(RW_NDEF_Sink_t *pSink) {
+  RW_NDEF_RegisterSink(&RW_NdefContext, pSink);
 }
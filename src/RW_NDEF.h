@@ -11,28 +11,226 @@
  * copyright or trademark. NXP must not be liable for any loss or damage
  *                          arising from its use.
  */
+#ifndef RW_NDEF_H
+#define RW_NDEF_H
+
 #include <Arduino.h>
 
 #define RW_MAX_NDEF_FILE_SIZE 500
 
+/* Define RW_NDEF_NO_STATIC_BUFFER to drop NdefBuffer, reads then need a
+ * context with its own buffer or a sink */
+#ifndef RW_NDEF_NO_STATIC_BUFFER
 extern unsigned char NdefBuffer[RW_MAX_NDEF_FILE_SIZE];
+#endif
 
 typedef void RW_NDEF_Callback_t(unsigned char *, unsigned short);
 typedef void CustomCallback_t(void);
+/* Receives the NDEF message being read chunk by chunk */
+typedef void RW_NDEF_Sink_t(unsigned char *pChunk, unsigned short Chunk_size,
+                            unsigned short Offset,
+                            unsigned short Message_size);
 
 #define RW_NDEF_TYPE_T1T 0x1
 #define RW_NDEF_TYPE_T2T 0x2
 #define RW_NDEF_TYPE_T3T 0x3
 #define RW_NDEF_TYPE_T4T 0x4
+#define RW_NDEF_TYPE_T5T 0x6
 #define RW_NDEF_TYPE_MIFARE 0x80
 
-extern unsigned char *pRW_NdefMessage;
-extern unsigned short RW_NdefMessage_size;
+/* Pages a T2T write compares with the tag before writing them */
+#define RW_NDEF_T2T_COMPARE_PAGES 128
+
+/* NDEF sectors a MAD can list: 1 to 15, and 17 to 39 with MAD2 */
+#define RW_NDEF_MIFARE_MAX_SECTORS 38
+
+/* Largest ISO15693 block size */
+#define RW_NDEF_T5T_MAX_BLOCK_SZ 32
+
+/* Reserved areas (Lock and Memory Control TLVs, fixed tag areas) remembered by
+ * the TLV parser */
+#define RW_NDEF_TLV_MAX_AREAS 3
+
+/* Incremental TLV parser state, see RW_NDEF_TLV.h. Addresses are byte
+ * addresses in the tag memory as defined by the tag type */
+typedef struct {
+  unsigned short Next;
+  unsigned short End;
+  bool Controls;
+  bool Locate;
+  unsigned char State;
+  unsigned char Type;
+  unsigned char Value[3];
+  unsigned short Length;
+  unsigned short MessagePtr;
+  unsigned short MessageSize;
+  /* First of the NULL TLVs ending the control TLVs while locating, 0 if none */
+  unsigned short Null;
+  unsigned char Areas;
+  unsigned short AreaStart[RW_NDEF_TLV_MAX_AREAS];
+  unsigned short AreaSize[RW_NDEF_TLV_MAX_AREAS];
+} RW_NDEF_TLV_t;
+
+typedef struct {
+  RW_NDEF_TLV_t Tlv;
+  unsigned char HR0;
+  unsigned char HR1;
+  unsigned char UID[4];
+  unsigned char BlkNb;
+  bool Segment;
+  unsigned char Chunk;
+  unsigned short Address;
+  unsigned short MessagePtr;
+  unsigned short ImageSize;
+} RW_NDEF_T1T_Ndef_t;
+
+typedef struct {
+  RW_NDEF_TLV_t Tlv;
+  unsigned short BlkNb;
+  unsigned char Sector;
+  unsigned char Resume;
+  unsigned char Pages;
+  bool FastRead;
+  bool Compare;
+  unsigned short ImageSize;
+  /* Data area address of the NDEF TLV, pages of its length and of its end */
+  unsigned short Address;
+  unsigned short LengthBlk;
+  unsigned short LastBlk;
+  /* Page PageBlk as read, for the bytes of the page kept as they are */
+  unsigned char Page[4];
+  unsigned short PageBlk;
+  /* A NULL TLV was added ahead of the NDEF TLV */
+  bool Pad;
+  unsigned char Dirty[RW_NDEF_T2T_COMPARE_PAGES / 8];
+} RW_NDEF_T2T_Ndef_t;
+
+typedef struct {
+  unsigned char IDm[8];
+  unsigned char Nbr;
+  unsigned char Nbw;
+  unsigned char Blocks;
+  unsigned char Attr[16];
+  unsigned short BlkNb;
+  unsigned short Ptr;
+  unsigned short Size;
+} RW_NDEF_T3T_Ndef_t;
 
-extern RW_NDEF_Callback_t *pRW_NDEF_PullCb;
-extern RW_NDEF_Callback_t *pRW_NDEF_PushCb;
+typedef struct {
+  unsigned char MappingVersion;
+  unsigned short MLe;
+  unsigned short MLc;
+  unsigned char FileID[2];
+  unsigned long MaxNdefFileSize;
+  unsigned char RdAccess;
+  unsigned char WrAccess;
+  /* 2 bytes NLEN, or 4 bytes ENLEN with mapping 3.0 */
+  unsigned char NlenSize;
+  unsigned short MessagePtr;
+  unsigned short MessageSize;
+} RW_NDEF_T4T_Ndef_t;
+
+typedef struct {
+  RW_NDEF_TLV_t Tlv;
+  unsigned char MadVersion;
+  unsigned char Crc;
+  unsigned char MadCrc;
+  /* NDEF sectors in increasing order */
+  unsigned char Sectors[RW_NDEF_MIFARE_MAX_SECTORS];
+  unsigned char SectorCount;
+  /* Sector authenticated, 0 before the first NDEF sector */
+  unsigned char Sector;
+  unsigned char BlkNb;
+  /* Data area address of BlkNb */
+  unsigned short Address;
+  unsigned short ImageSize;
+} RW_NDEF_MIFARE_Ndef_t;
+
+typedef struct {
+  RW_NDEF_TLV_t Tlv;
+  unsigned char Mode;
+  /* Transmission order, LSB first */
+  unsigned char UID[8];
+  unsigned char BlockSize;
+  unsigned char CC[8];
+  unsigned char CCSize;
+  unsigned char CCRead;
+  /* 2 bytes block numbers */
+  bool Extended;
+  bool ReadMultiple;
+  bool WriteMultiple;
+  unsigned short BlkNb;
+  /* Blocks of the last read or write command */
+  unsigned short Blocks;
+  /* Where the image is written, and the block of the NDEF length */
+  unsigned short Address;
+  unsigned short LengthBlk;
+  unsigned short ImageSize;
+  /* Block holding Address as read */
+  unsigned char Head[RW_NDEF_T5T_MAX_BLOCK_SZ];
+} RW_NDEF_T5T_Ndef_t;
+
+/* State of one NDEF operation, owned by the caller */
+typedef struct {
+  /* Receives the message read, unused when a sink is registered */
+  unsigned char *pBuffer;
+  unsigned short BufferSize;
+  /* Message to write */
+  unsigned char *pMessage;
+  unsigned short MessageSize;
+  /* Last NDEF message read, NULL if the last read failed */
+  unsigned char *pLastMessage;
+  unsigned short LastMessageSize;
+  RW_NDEF_Callback_t *pPullCb;
+  RW_NDEF_Callback_t *pPushCb;
+  RW_NDEF_Sink_t *pSink;
+  /* Called once a message is read (or failed to be) */
+  CustomCallback_t *pReceivedCb;
+  /* Largest data packet payload, 0 stands for the NCI maximum of 255 */
+  unsigned char MaxPayload;
+  unsigned char Type;
+  unsigned char State;
+  union {
+    RW_NDEF_T1T_Ndef_t T1T;
+    RW_NDEF_T2T_Ndef_t T2T;
+    RW_NDEF_T3T_Ndef_t T3T;
+    RW_NDEF_T4T_Ndef_t T4T;
+    RW_NDEF_T5T_Ndef_t T5T;
+    RW_NDEF_MIFARE_Ndef_t MIFARE;
+  } Tag;
+} RW_NDEF_Context_t;
+
+/* Static initializer of a context, same as RW_NDEF_InitContext() */
+#define RW_NDEF_CONTEXT_INIT(pBuffer, Buffer_size)                             \
+  {pBuffer, Buffer_size, NULL, 0, NULL, 0, NULL, NULL, NULL, NULL, 0, 0, 0, {}}
+
+/* Context used by the functions without a context argument */
+extern RW_NDEF_Context_t RW_NdefContext;
+
+/* Hands every message read, whatever the context, to NdefMessage which keeps
+ * a single process wide copy */
 extern RW_NDEF_Callback_t *updateNdefMessageCallback;
-extern CustomCallback_t *ndefReceivedCallback;
+
+void RW_NDEF_InitContext(RW_NDEF_Context_t *pCtx, unsigned char *pBuffer,
+                         unsigned short Buffer_size);
+void RW_NDEF_Reset(RW_NDEF_Context_t *pCtx, unsigned char type);
+void RW_NDEF_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                       unsigned short Cmd_size, unsigned char *Rsp,
+                       unsigned short *pRsp_size);
+void RW_NDEF_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                        unsigned short Cmd_size, unsigned char *Rsp,
+                        unsigned short *pRsp_size);
+bool RW_NDEF_SetMessage(RW_NDEF_Context_t *pCtx, unsigned char *pMessage,
+                        unsigned short Message_size, void *pCb);
+void RW_NDEF_RegisterPullCallback(RW_NDEF_Context_t *pCtx, void *pCb);
+void RW_NDEF_RegisterSink(RW_NDEF_Context_t *pCtx, RW_NDEF_Sink_t *pSink);
+void RW_NDEF_SetMaxPayload(RW_NDEF_Context_t *pCtx, unsigned char MaxPayload);
+void RW_NDEF_Notify(RW_NDEF_Context_t *pCtx, unsigned char *pMessage,
+                    unsigned short Message_size);
+bool RW_NDEF_Fits(RW_NDEF_Context_t *pCtx, unsigned short Message_size);
+void RW_NDEF_Store(RW_NDEF_Context_t *pCtx, unsigned short Offset,
+                   unsigned char *pChunk, unsigned short Chunk_size,
+                   unsigned short Message_size);
 
 void RW_NDEF_Reset(unsigned char type);
 void RW_NDEF_Read_Next(unsigned char *pCmd, unsigned short Cmd_size,
@@ -42,5 +240,9 @@ void RW_NDEF_Write_Next(unsigned char *pCmd, unsigned short Cmd_size,
 bool RW_NDEF_SetMessage(unsigned char *pMessage, unsigned short Message_size,
                         void *pCb);
 void RW_NDEF_RegisterPullCallback(void *pCb);
+void RW_NDEF_RegisterSink(RW_NDEF_Sink_t *pSink);
 void registerUpdateNdefMessageCallback(RW_NDEF_Callback_t function);
+/* Received callback of RW_NdefContext */
 void registerNdefReceivedCallback(CustomCallback_t function);
+
+#endif
@@ -15,349 +15,352 @@
 // #ifdef RW_SUPPORT
 // #ifndef NO_NDEF_SUPPORT
 #include "RW_NDEF.h"
+#include "RW_NDEF_TLV.h"
 #include "tool.h"
 
 /*
-    TODO: Only simplified scenario is implemented yet:
-     NDEF data stored in contiguous sector and started at sector #1
+    The NDEF data area is made of the data blocks of the sectors the MAD
+    (MAD1 in sector 0, MAD2 in sector 16 of 4K cards) gives to the NFC Forum
+    application, in sector order. These sectors need not be contiguous
 */
 
 #define MIFARE_FUNCTION_CLUSTER 0xE1
 #define MIFARE_NFC_CLUSTER 0x03
-#define MIFARE_NDEF_TLV 0x03
+
+#define MIFARE_BLOCK_SZ 16
+/* XCHG_DATA prefix, block content and status */
+#define MIFARE_READ_RSP_SZ (MIFARE_BLOCK_SZ + 2)
+
+/* Authentication key selectors: MAD key for sectors 0 and 16, NFC Forum key
+ * for the NDEF sectors */
+#define MIFARE_MAD_KEY 0x00
+#define MIFARE_NDEF_KEY 0x01
+
+/* General Purpose Byte of the sector 0 trailer */
+#define MIFARE_GPB_BLOCK 3
+#define MIFARE_GPB 9
+#define MIFARE_GPB_DA 0x80 /* MAD available */
+#define MIFARE_GPB_ADV 0x03 /* MAD version */
+
+#define MIFARE_MAD1_BLOCK 1
+#define MIFARE_MAD1_LAST_BLOCK 2
+#define MIFARE_MAD2_SECTOR 16
+#define MIFARE_MAD2_BLOCK 64
+#define MIFARE_MAD2_LAST_BLOCK 66
+
+/* MAD CRC-8: x^8 + x^4 + x^3 + x^2 + 1, preset to C7h */
+#define MIFARE_MAD_CRC_POLY 0x1D
+#define MIFARE_MAD_CRC_PRESET 0xC7
+
+/* Sectors 32 to 39 of a 4K card have 16 blocks, the others 4 */
+#define MIFARE_SECTOR_BLOCK(Sector)                                            \
+  (((Sector) < 32) ? (Sector) * 4 : 128 + ((Sector) - 32) * 16)
+#define MIFARE_BLOCK_SECTOR(Blk)                                               \
+  (((Blk) < 128) ? (Blk) / 4 : 32 + ((Blk) - 128) / 16)
+/* Data blocks of a sector, its trailer excluded */
+#define MIFARE_SECTOR_DATA_BLOCKS(Sector) (((Sector) < 32) ? 3 : 15)
 
 typedef enum {
   Initial,
   Authenticated0,
   Reading_GPB,
+  Reading_MAD,
+  Authenticated_MAD2,
   Authenticated,
-  Reading_FirstBlk,
   Reading_Data,
   Writing_Data1,
-  Writing_Data2,
-  Writing_Data
+  Writing_Data2
 } RW_NDEF_MIFARE_state_t;
 
-typedef struct {
-  bool WriteOp;
-  unsigned char BlkNb;
-  unsigned short MessagePtr;
-  unsigned short MessageSize;
-  unsigned char *pMessage;
-} RW_NDEF_MIFARE_Ndef_t;
+void RW_NDEF_MIFARE_Reset(RW_NDEF_Context_t *pCtx) { pCtx->State = Initial; }
 
-static RW_NDEF_MIFARE_state_t eRW_NDEF_MIFARE_State = Initial;
-static RW_NDEF_MIFARE_Ndef_t RW_NDEF_MIFARE_Ndef;
+static void RW_NDEF_MIFARE_Authenticate(unsigned char Sector,
+                                        unsigned char Key, unsigned char *pCmd,
+                                        unsigned short *pCmd_size) {
+  pCmd[0] = 0x40;
+  pCmd[1] = Sector;
+  pCmd[2] = Key;
+  *pCmd_size = 3;
+}
 
-void RW_NDEF_MIFARE_Reset(void) {
-  eRW_NDEF_MIFARE_State = Initial;
-  RW_NDEF_MIFARE_Ndef.pMessage = NdefBuffer;
+static void RW_NDEF_MIFARE_Read(unsigned char BlkNb, unsigned char *pCmd,
+                                unsigned short *pCmd_size) {
+  pCmd[0] = 0x10;
+  pCmd[1] = 0x30;
+  pCmd[2] = BlkNb;
+  *pCmd_size = 3;
 }
 
-void RW_NDEF_MIFARE_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                              unsigned char *pCmd, unsigned short *pCmd_size) {
-  /* By default no further command to be sent */
-  *pCmd_size = 0;
+static unsigned char RW_NDEF_MIFARE_Crc(unsigned char Crc,
+                                        unsigned char Byte) {
+  Crc ^= Byte;
+  for (unsigned char i = 0; i < 8; i++)
+    Crc = (Crc & 0x80) ? (Crc << 1) ^ MIFARE_MAD_CRC_POLY : Crc << 1;
+  return Crc;
+}
 
-  switch (eRW_NDEF_MIFARE_State) {
+/* Feed the MAD block just read: CRC byte, info byte, then one AID per sector,
+ * application code first. NDEF sectors are added to the sector list */
+static void RW_NDEF_MIFARE_Mad(RW_NDEF_MIFARE_Ndef_t *pNdef,
+                               unsigned char *pData) {
+  bool Mad2 = pNdef->BlkNb >= MIFARE_MAD2_BLOCK;
+  unsigned char Offset =
+      (pNdef->BlkNb - (Mad2 ? MIFARE_MAD2_BLOCK : MIFARE_MAD1_BLOCK)) *
+      MIFARE_BLOCK_SZ;
+
+  for (unsigned char i = 0; i < MIFARE_BLOCK_SZ; i++) {
+    unsigned char Pos = Offset + i;
+
+    if (Pos == 0) {
+      pNdef->MadCrc = pData[i];
+      pNdef->Crc = MIFARE_MAD_CRC_PRESET;
+      continue;
+    }
+    pNdef->Crc = RW_NDEF_MIFARE_Crc(pNdef->Crc, pData[i]);
+
+    if ((Pos >= 2) && ((Pos % 2) == 0) &&
+        (pData[i] == MIFARE_NFC_CLUSTER) &&
+        (pData[i + 1] == MIFARE_FUNCTION_CLUSTER) &&
+        (pNdef->SectorCount < RW_NDEF_MIFARE_MAX_SECTORS))
+      pNdef->Sectors[pNdef->SectorCount++] =
+          (Mad2 ? MIFARE_MAD2_SECTOR : 0) + Pos / 2;
+  }
+}
+
+/* Build the NDEF sector list from the MAD, returns true once it is complete.
+ * Sectors 0 and 16 are authenticated once each */
+static bool RW_NDEF_MIFARE_Layout(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                                  unsigned short Rsp_size, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_MIFARE_Ndef_t *pNdef = &pCtx->Tag.MIFARE;
+
+  switch (pCtx->State) {
   case Initial:
     /* Authenticating first sector */
-    pCmd[0] = 0x40;
-    pCmd[1] = 0x00;
-    pCmd[2] = 0x00;
-    *pCmd_size = 3;
-    eRW_NDEF_MIFARE_State = Authenticated0;
+    RW_NDEF_MIFARE_Authenticate(0, MIFARE_MAD_KEY, pCmd, pCmd_size);
+    pCtx->State = Authenticated0;
     break;
 
   case Authenticated0:
     if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
       /* Read GPB */
-      pCmd[0] = 0x10;
-      pCmd[1] = 0x30;
-      pCmd[2] = 0x01;
-      *pCmd_size = 3;
-      eRW_NDEF_MIFARE_State = Reading_GPB;
+      RW_NDEF_MIFARE_Read(MIFARE_GPB_BLOCK, pCmd, pCmd_size);
+      pCtx->State = Reading_GPB;
     }
     break;
 
   case Reading_GPB:
-    if ((Rsp_size == 18) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF format ?*/
-      if ((pRsp[3] == MIFARE_NFC_CLUSTER) &&
-          (pRsp[4] == MIFARE_FUNCTION_CLUSTER)) {
-        pCmd[0] = 0x40;
-        pCmd[1] = 0x01;
-        pCmd[2] = 0x01;
-        *pCmd_size = 3;
-        eRW_NDEF_MIFARE_State = Authenticated;
-
-        RW_NDEF_MIFARE_Ndef.BlkNb = 4;
+    if ((Rsp_size == MIFARE_READ_RSP_SZ) && (pRsp[Rsp_size - 1] == 0x00)) {
+      unsigned char Gpb = pRsp[1 + MIFARE_GPB];
+
+      /* Is MAD1 or MAD2 available ? */
+      if ((Gpb & MIFARE_GPB_DA) && ((Gpb & MIFARE_GPB_ADV) >= 1) &&
+          ((Gpb & MIFARE_GPB_ADV) <= 2)) {
+        pNdef->MadVersion = Gpb & MIFARE_GPB_ADV;
+        pNdef->SectorCount = 0;
+        pNdef->BlkNb = MIFARE_MAD1_BLOCK;
+        RW_NDEF_MIFARE_Read(pNdef->BlkNb, pCmd, pCmd_size);
+        pCtx->State = Reading_MAD;
       }
     }
     break;
 
-  case Authenticated:
+  case Authenticated_MAD2:
     if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* First NDEF data block to read ?*/
-      if (RW_NDEF_MIFARE_Ndef.BlkNb == 4) {
-        eRW_NDEF_MIFARE_State = Reading_FirstBlk;
-      } else {
-        RW_NDEF_MIFARE_Ndef.BlkNb++;
-        eRW_NDEF_MIFARE_State = Reading_Data;
-      }
+      pNdef->BlkNb = MIFARE_MAD2_BLOCK;
+      RW_NDEF_MIFARE_Read(pNdef->BlkNb, pCmd, pCmd_size);
+      pCtx->State = Reading_MAD;
+    }
+    break;
 
-      /* Read block */
-      pCmd[0] = 0x10;
-      pCmd[1] = 0x30;
-      pCmd[2] = RW_NDEF_MIFARE_Ndef.BlkNb;
-      *pCmd_size = 3;
+  case Reading_MAD:
+    if ((Rsp_size == MIFARE_READ_RSP_SZ) && (pRsp[Rsp_size - 1] == 0x00)) {
+      RW_NDEF_MIFARE_Mad(pNdef, &pRsp[1]);
+
+      if ((pNdef->BlkNb != MIFARE_MAD1_LAST_BLOCK) &&
+          (pNdef->BlkNb != MIFARE_MAD2_LAST_BLOCK)) {
+        pNdef->BlkNb++;
+        RW_NDEF_MIFARE_Read(pNdef->BlkNb, pCmd, pCmd_size);
+      } else if (pNdef->Crc != pNdef->MadCrc) {
+        /* Corrupted MAD, no further command */
+      } else if ((pNdef->BlkNb == MIFARE_MAD1_LAST_BLOCK) &&
+                 (pNdef->MadVersion == 2)) {
+        RW_NDEF_MIFARE_Authenticate(MIFARE_MAD2_SECTOR, MIFARE_MAD_KEY, pCmd,
+                                    pCmd_size);
+        pCtx->State = Authenticated_MAD2;
+      } else
+        return true;
     }
     break;
 
-  case Reading_FirstBlk:
-    if ((Rsp_size == 18) && (pRsp[Rsp_size - 1] == 0x00)) {
-      unsigned char Tmp = 1;
-      /* If not NDEF Type skip TLV */
-      while (pRsp[Tmp] != MIFARE_NDEF_TLV) {
-        Tmp += 2 + pRsp[Tmp + 1];
-        if (Tmp > Rsp_size)
-          return;
-      }
+  default:
+    break;
+  }
+  return false;
+}
 
-      if (pRsp[Tmp + 1] == 0xFF) {
-        RW_NDEF_MIFARE_Ndef.MessageSize = (pRsp[Tmp + 2] << 8) + pRsp[Tmp + 3];
-        Tmp += 2;
-      } else
-        RW_NDEF_MIFARE_Ndef.MessageSize = pRsp[Tmp + 1];
+/* Size of the NDEF data area */
+static unsigned short RW_NDEF_MIFARE_Size(const RW_NDEF_MIFARE_Ndef_t *pNdef) {
+  unsigned short Size = 0;
 
-      /* If provisioned buffer is not large enough or message is empty, notify
-       * the application and stop reading */
-      if ((RW_NDEF_MIFARE_Ndef.MessageSize > RW_MAX_NDEF_FILE_SIZE) ||
-          (RW_NDEF_MIFARE_Ndef.MessageSize == 0)) {
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(NULL, 0);
+  for (unsigned char i = 0; i < pNdef->SectorCount; i++)
+    Size += MIFARE_SECTOR_DATA_BLOCKS(pNdef->Sectors[i]) * MIFARE_BLOCK_SZ;
+  return Size;
+}
 
-        // Run custom callbacks
-        if (updateNdefMessageCallback != NULL) {
-          updateNdefMessageCallback(NULL, 0);
-        }
+/* Data block holding an address of the NDEF data area */
+static unsigned char RW_NDEF_MIFARE_Block(const RW_NDEF_MIFARE_Ndef_t *pNdef,
+                                          unsigned short Address) {
+  for (unsigned char i = 0; i < pNdef->SectorCount; i++) {
+    unsigned char Sector = pNdef->Sectors[i];
+    unsigned short Size = MIFARE_SECTOR_DATA_BLOCKS(Sector) * MIFARE_BLOCK_SZ;
 
-        if (ndefReceivedCallback != NULL) {
-          ndefReceivedCallback();
-        }
+    if (Address < Size)
+      return MIFARE_SECTOR_BLOCK(Sector) + Address / MIFARE_BLOCK_SZ;
+    Address -= Size;
+  }
+  return 0;
+}
 
-        break;
-      }
+/* Go to the block holding Address, its sector is authenticated first when
+ * entered. Sectors are entered in increasing order, so once each */
+static bool RW_NDEF_MIFARE_Goto(RW_NDEF_MIFARE_Ndef_t *pNdef,
+                                unsigned short Address, unsigned char *pCmd,
+                                unsigned short *pCmd_size) {
+  pNdef->Address = Address - (Address % MIFARE_BLOCK_SZ);
+  pNdef->BlkNb = RW_NDEF_MIFARE_Block(pNdef, Address);
 
-      /* Is NDEF read already completed ? */
-      if (RW_NDEF_MIFARE_Ndef.MessageSize <= ((Rsp_size - 1) - Tmp - 2)) {
-        memcpy(RW_NDEF_MIFARE_Ndef.pMessage, &pRsp[Tmp + 2],
-               RW_NDEF_MIFARE_Ndef.MessageSize);
-
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL) {
-          pRW_NDEF_PullCb(RW_NDEF_MIFARE_Ndef.pMessage,
-                          RW_NDEF_MIFARE_Ndef.MessageSize);
-        }
-
-        // Run custom callbacks
-        if (updateNdefMessageCallback != NULL) {
-          updateNdefMessageCallback(RW_NDEF_MIFARE_Ndef.pMessage,
-                                    RW_NDEF_MIFARE_Ndef.MessageSize);
-        }
-
-        if (ndefReceivedCallback != NULL) {
-          ndefReceivedCallback();
-        }
-      } else {
-        RW_NDEF_MIFARE_Ndef.MessagePtr = (Rsp_size - 1) - Tmp - 2;
-        memcpy(RW_NDEF_MIFARE_Ndef.pMessage, &pRsp[Tmp + 2],
-               RW_NDEF_MIFARE_Ndef.MessagePtr);
-        RW_NDEF_MIFARE_Ndef.BlkNb++;
-
-        /* Read next block */
-        pCmd[0] = 0x10;
-        pCmd[1] = 0x30;
-        pCmd[2] = RW_NDEF_MIFARE_Ndef.BlkNb;
-        *pCmd_size = 3;
-        eRW_NDEF_MIFARE_State = Reading_Data;
-      }
+  if (MIFARE_BLOCK_SECTOR(pNdef->BlkNb) == pNdef->Sector)
+    return true;
+
+  pNdef->Sector = MIFARE_BLOCK_SECTOR(pNdef->BlkNb);
+  RW_NDEF_MIFARE_Authenticate(pNdef->Sector, MIFARE_NDEF_KEY, pCmd, pCmd_size);
+  return false;
+}
+
+static void RW_NDEF_MIFARE_ReadMore(RW_NDEF_Context_t *pCtx,
+                                    unsigned char *pCmd,
+                                    unsigned short *pCmd_size) {
+  RW_NDEF_MIFARE_Ndef_t *pNdef = &pCtx->Tag.MIFARE;
+
+  if (RW_NDEF_MIFARE_Goto(pNdef, RW_NDEF_TLV_Next(&pNdef->Tlv), pCmd,
+                          pCmd_size)) {
+    RW_NDEF_MIFARE_Read(pNdef->BlkNb, pCmd, pCmd_size);
+    pCtx->State = Reading_Data;
+  } else
+    pCtx->State = Authenticated;
+}
+
+void RW_NDEF_MIFARE_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                              unsigned short Rsp_size, unsigned char *pCmd,
+                              unsigned short *pCmd_size) {
+  RW_NDEF_MIFARE_Ndef_t *pNdef = &pCtx->Tag.MIFARE;
+
+  /* By default no further command to be sent */
+  *pCmd_size = 0;
+
+  switch (pCtx->State) {
+  case Authenticated:
+    if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
+      /* Read block */
+      RW_NDEF_MIFARE_Read(pNdef->BlkNb, pCmd, pCmd_size);
+      pCtx->State = Reading_Data;
     }
     break;
 
   case Reading_Data:
-    if ((Rsp_size == 18) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF read already completed ? */
-      if ((RW_NDEF_MIFARE_Ndef.MessageSize - RW_NDEF_MIFARE_Ndef.MessagePtr) <
-          16) {
-        memcpy(&RW_NDEF_MIFARE_Ndef.pMessage[RW_NDEF_MIFARE_Ndef.MessagePtr],
-               pRsp + 1,
-               RW_NDEF_MIFARE_Ndef.MessageSize -
-                   RW_NDEF_MIFARE_Ndef.MessagePtr);
-
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL) {
-          pRW_NDEF_PullCb(RW_NDEF_MIFARE_Ndef.pMessage,
-                          RW_NDEF_MIFARE_Ndef.MessageSize);
-        }
-
-        // Run custom callbacks
-        if (updateNdefMessageCallback != NULL) {
-          updateNdefMessageCallback(RW_NDEF_MIFARE_Ndef.pMessage,
-                                    RW_NDEF_MIFARE_Ndef.MessageSize);
-        }
-
-        if (ndefReceivedCallback != NULL) {
-          ndefReceivedCallback();
-        }
-      } else {
-        memcpy(&RW_NDEF_MIFARE_Ndef.pMessage[RW_NDEF_MIFARE_Ndef.MessagePtr],
-               pRsp + 1, 16);
-        RW_NDEF_MIFARE_Ndef.MessagePtr += 16;
-        RW_NDEF_MIFARE_Ndef.BlkNb++;
-
-        /* Is Blk on next sector ?*/
-        if (((RW_NDEF_MIFARE_Ndef.BlkNb + 1) % 4) == 0) {
-          /* Authenticate next block */
-          pCmd[0] = 0x40;
-          pCmd[1] = (RW_NDEF_MIFARE_Ndef.BlkNb + 1) / 4;
-          pCmd[2] = 0x01;
-          *pCmd_size = 3;
-          eRW_NDEF_MIFARE_State = Authenticated;
-        } else {
-          /* Read next block */
-          pCmd[0] = 0x10;
-          pCmd[1] = 0x30;
-          pCmd[2] = RW_NDEF_MIFARE_Ndef.BlkNb;
-          *pCmd_size = 3;
-        }
-      }
+    if ((Rsp_size == MIFARE_READ_RSP_SZ) && (pRsp[Rsp_size - 1] == 0x00)) {
+      if (RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, pNdef->Address, pRsp + 1,
+                            MIFARE_BLOCK_SZ) == RW_NDEF_TLV_MORE)
+        RW_NDEF_MIFARE_ReadMore(pCtx, pCmd, pCmd_size);
     }
     break;
 
   default:
+    /* Is NDEF format ? */
+    if (RW_NDEF_MIFARE_Layout(pCtx, pRsp, Rsp_size, pCmd, pCmd_size) &&
+        (pNdef->SectorCount > 0)) {
+      RW_NDEF_TLV_Init(&pNdef->Tlv, 0, RW_NDEF_MIFARE_Size(pNdef), false);
+      pNdef->Sector = 0;
+      RW_NDEF_MIFARE_ReadMore(pCtx, pCmd, pCmd_size);
+    }
     break;
   }
 }
 
-void RW_NDEF_MIFARE_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                               unsigned char *pCmd, unsigned short *pCmd_size) {
+/* Write the block holding the image from Address on, in two steps: WRITE
+ * command, then the block content */
+static void RW_NDEF_MIFARE_WriteMore(RW_NDEF_Context_t *pCtx,
+                                     unsigned char *pCmd,
+                                     unsigned short *pCmd_size) {
+  RW_NDEF_MIFARE_Ndef_t *pNdef = &pCtx->Tag.MIFARE;
+
+  if (RW_NDEF_MIFARE_Goto(pNdef, pNdef->Address, pCmd, pCmd_size)) {
+    pCmd[0] = 0x10;
+    pCmd[1] = 0xA0;
+    pCmd[2] = pNdef->BlkNb;
+    *pCmd_size = 3;
+    pCtx->State = Writing_Data1;
+  } else
+    pCtx->State = Authenticated;
+}
+
+void RW_NDEF_MIFARE_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                               unsigned short Rsp_size, unsigned char *pCmd,
+                               unsigned short *pCmd_size) {
+  RW_NDEF_MIFARE_Ndef_t *pNdef = &pCtx->Tag.MIFARE;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_MIFARE_State) {
-  case Initial:
-    /* Authenticating first sector */
-    pCmd[0] = 0x40;
-    pCmd[1] = 0x00;
-    pCmd[2] = 0x00;
-    *pCmd_size = 3;
-    eRW_NDEF_MIFARE_State = Authenticated0;
+  switch (pCtx->State) {
+  case Authenticated:
+    if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00))
+      RW_NDEF_MIFARE_WriteMore(pCtx, pCmd, pCmd_size);
     break;
 
-  case Authenticated0:
-    if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Read MAD */
+  case Writing_Data1:
+    if ((Rsp_size == 3) && (pRsp[Rsp_size - 1] == 0x00)) {
       pCmd[0] = 0x10;
-      pCmd[1] = 0x30;
-      pCmd[2] = 0x01;
-      *pCmd_size = 3;
-      eRW_NDEF_MIFARE_State = Reading_GPB;
+      for (unsigned char i = 0; i < MIFARE_BLOCK_SZ; i++)
+        pCmd[1 + i] = RW_NDEF_TLV_ImageByte(pCtx, pNdef->Address + i,
+                                            pNdef->ImageSize);
+      *pCmd_size = 1 + MIFARE_BLOCK_SZ;
+      pCtx->State = Writing_Data2;
     }
     break;
 
-  case Reading_GPB:
-    if ((Rsp_size == 18) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF format ?*/
-      if ((pRsp[3] == MIFARE_NFC_CLUSTER) &&
-          (pRsp[4] == MIFARE_FUNCTION_CLUSTER)) {
-        pCmd[0] = 0x40;
-        pCmd[1] = 0x01;
-        pCmd[2] = 0x01;
-        *pCmd_size = 3;
-        eRW_NDEF_MIFARE_State = Writing_Data1;
-        RW_NDEF_MIFARE_Ndef.MessagePtr = 0;
-        RW_NDEF_MIFARE_Ndef.BlkNb = 4;
-      }
-    }
-    break;
-
-  case Writing_Data1:
-    if ((pRsp[Rsp_size - 1] == 0x00)) {
+  case Writing_Data2:
+    if ((Rsp_size > 0) && (pRsp[Rsp_size - 1] == 0x00)) {
       /* Is NDEF write already completed ? */
-      if (RW_NdefMessage_size <= RW_NDEF_MIFARE_Ndef.MessagePtr) {
+      if (pNdef->Address + MIFARE_BLOCK_SZ >= pNdef->ImageSize) {
         /* Notify application of the NDEF send completion */
-        if (pRW_NDEF_PushCb != NULL)
-          pRW_NDEF_PushCb(pRW_NdefMessage, RW_NdefMessage_size);
-      } else if (((RW_NDEF_MIFARE_Ndef.BlkNb + 1) % 4) == 0) {
-        /* Authenticate next block */
-        pCmd[0] = 0x40;
-        pCmd[1] = (RW_NDEF_MIFARE_Ndef.BlkNb + 1) / 4;
-        pCmd[2] = 0x01;
-        *pCmd_size = 3;
-        eRW_NDEF_MIFARE_State = Writing_Data1;
-        RW_NDEF_MIFARE_Ndef.BlkNb++;
+        if (pCtx->pPushCb != NULL)
+          pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
       } else {
-        pCmd[0] = 0x10;
-        pCmd[1] = 0xA0;
-        pCmd[2] = RW_NDEF_MIFARE_Ndef.BlkNb;
-        *pCmd_size = 3;
-        eRW_NDEF_MIFARE_State = Writing_Data2;
+        pNdef->Address += MIFARE_BLOCK_SZ;
+        RW_NDEF_MIFARE_WriteMore(pCtx, pCmd, pCmd_size);
       }
     }
     break;
 
-  case Writing_Data2:
-    if ((Rsp_size == 3) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* First block to write ? */
-      if (RW_NDEF_MIFARE_Ndef.BlkNb == 4) {
-        pCmd[0] = 0x10;
-        pCmd[1] = 0x00;
-        pCmd[2] = 0x00;
-        pCmd[3] = 0x03;
-        if (RW_NdefMessage_size > 0xFF) {
-          pCmd[4] = 0xFF;
-          pCmd[5] = (RW_NdefMessage_size & 0xFF00) >> 8;
-          pCmd[6] = RW_NdefMessage_size & 0xFF;
-          memcpy(&pCmd[7], pRW_NdefMessage, 10);
-          RW_NDEF_MIFARE_Ndef.MessagePtr = 10;
-        } else {
-          pCmd[4] = (unsigned char)RW_NdefMessage_size;
-          memcpy(&pCmd[5], pRW_NdefMessage, 12);
-          RW_NDEF_MIFARE_Ndef.MessagePtr = 12;
-        }
-      } else {
-        pCmd[0] = 0x10;
-        memcpy(&pCmd[1], pRW_NdefMessage + RW_NDEF_MIFARE_Ndef.MessagePtr, 16);
-        RW_NDEF_MIFARE_Ndef.MessagePtr += 16;
-      }
-      *pCmd_size = 17;
-      RW_NDEF_MIFARE_Ndef.BlkNb++;
-      eRW_NDEF_MIFARE_State = Writing_Data1;
-    }
-    break;
+  default:
+    /* Is NDEF format ? */
+    if (RW_NDEF_MIFARE_Layout(pCtx, pRsp, Rsp_size, pCmd, pCmd_size)) {
+      unsigned short Size = RW_NDEF_MIFARE_Size(pNdef);
 
-  case Writing_Data:
-    if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF write already completed ? */
-      if (RW_NdefMessage_size <= RW_NDEF_MIFARE_Ndef.MessagePtr) {
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PushCb != NULL)
-          pRW_NDEF_PushCb(pRW_NdefMessage, RW_NdefMessage_size);
-      } else {
-        /* Write NDEF content */
-        pCmd[0] = 0xA2;
-        pCmd[1] = RW_NDEF_MIFARE_Ndef.BlkNb;
-        memcpy(&pCmd[2], pRW_NdefMessage + RW_NDEF_MIFARE_Ndef.MessagePtr, 4);
-        *pCmd_size = 6;
-
-        RW_NDEF_MIFARE_Ndef.MessagePtr += 4;
-        RW_NDEF_MIFARE_Ndef.BlkNb++;
-      }
-    }
-    break;
+      /* Is size enough ? */
+      pNdef->ImageSize = RW_NDEF_TLV_ImageSize(pCtx);
+      if (pNdef->ImageSize > Size)
+        break;
+      /* Terminate the TLVs if there is room left */
+      if (pNdef->ImageSize < Size)
+        pNdef->ImageSize++;
 
-  default:
+      pNdef->Sector = 0;
+      pNdef->Address = 0;
+      RW_NDEF_MIFARE_WriteMore(pCtx, pCmd, pCmd_size);
+    }
     break;
   }
 }
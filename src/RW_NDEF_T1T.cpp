@@ -15,151 +15,331 @@
 // #ifdef RW_SUPPORT
 // #ifndef NO_NDEF_SUPPORT
 #include "RW_NDEF.h"
+#include "RW_NDEF_TLV.h"
 #include "tool.h"
 
 #define T1T_MAGIC_NUMBER 0xE1
-#define T1T_NDEF_TLV 0x03
+#define T1T_BLOCK_SZ 8
+#define T1T_SEGMENT_SZ 128
+/* CC bytes: NDEF magic number, version, memory size and access */
+#define T1T_NMN 0x08
+#define T1T_TMS 0x0A
+#define T1T_RWA 0x0B
+#define T1T_DATA_AREA 0x0C
+/* Blocks 0x0D to 0x0F of the first segment hold reserved and lock bytes */
+#define T1T_RESERVED 0x68
+#define T1T_RESERVED_SZ 24
+/* RALL returns blocks 0x00 to 0x0E */
+#define T1T_RALL_SZ 120
+/* Static memory tags (96 bytes) have no READ8/RSEG/WRITE-E8 */
+#define T1T_IS_STATIC(HR0) (((HR0)&0x0F) == 0x01)
 
 const unsigned char T1T_RID[] = {0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 const unsigned char T1T_RALL[] = {0x00, 0x00, 0x00};
 const unsigned char T1T_READ8[] = {0x02, 0x00, 0x00, 0x00, 0x00,
                                    0x00, 0x00, 0x00, 0x00, 0x00};
+const unsigned char T1T_RSEG[] = {0x10, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00};
+const unsigned char T1T_WRITE_E[] = {0x53, 0x00, 0x00};
+const unsigned char T1T_WRITE_NE[] = {0x1A, 0x00, 0x00};
+const unsigned char T1T_WRITE_E8[] = {0x54, 0x00, 0x00, 0x00, 0x00,
+                                      0x00, 0x00, 0x00, 0x00, 0x00};
 
 typedef enum {
   Initial,
   Getting_ID,
   Reading_CardContent,
-  Reading_NDEF
+  Reading_NDEF,
+  Clearing_NMN,
+  Writing_Data,
+  Setting_NMN
 } RW_NDEF_T1T_state_t;
 
-typedef struct {
-  unsigned char HR0;
-  unsigned char HR1;
-  unsigned char UID[4];
-  unsigned char BlkNb;
-  unsigned short MessagePtr;
-  unsigned short MessageSize;
-  unsigned char *pMessage;
-} RW_NDEF_T1T_Ndef_t;
-
-static RW_NDEF_T1T_state_t eRW_NDEF_T1T_State = Initial;
-static RW_NDEF_T1T_Ndef_t RW_NDEF_T1T_Ndef;
-
-void RW_NDEF_T1T_Reset(void) {
-  eRW_NDEF_T1T_State = Initial;
-  RW_NDEF_T1T_Ndef.pMessage = NdefBuffer;
+void RW_NDEF_T1T_Reset(RW_NDEF_Context_t *pCtx) { pCtx->State = Initial; }
+
+/* Copy the command template and append the UID */
+static void RW_NDEF_T1T_Command(RW_NDEF_T1T_Ndef_t *pNdef,
+                                const unsigned char *pTemplate,
+                                unsigned short Size, unsigned char *pCmd,
+                                unsigned short *pCmd_size) {
+  memcpy(pCmd, pTemplate, Size);
+  memcpy(&pCmd[Size], pNdef->UID, sizeof(pNdef->UID));
+  *pCmd_size = Size + sizeof(pNdef->UID);
+}
+
+/* Is RID answered ? Then read the first segment with RALL */
+static void RW_NDEF_T1T_GettingID(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                                  unsigned short Rsp_size, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+
+  if ((Rsp_size == 7) && (pRsp[Rsp_size - 1] == 0x00)) {
+    /* Fill File structure */
+    pNdef->HR0 = pRsp[0];
+    pNdef->HR1 = pRsp[1];
+    memcpy(pNdef->UID, &pRsp[2], sizeof(pNdef->UID));
+
+    /* Read full card content */
+    RW_NDEF_T1T_Command(pNdef, T1T_RALL, sizeof(T1T_RALL), pCmd, pCmd_size);
+    pCtx->State = Reading_CardContent;
+  }
+}
+
+/* Is RALL answered by an NDEF formatted tag ? Then start parsing the TLVs of
+ * the data area, the size of which is given by the CC */
+static bool RW_NDEF_T1T_CardContent(RW_NDEF_Context_t *pCtx,
+                                    unsigned char *pRsp,
+                                    unsigned short Rsp_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+
+  if ((Rsp_size != T1T_RALL_SZ + 3) || (pRsp[Rsp_size - 1] != 0x00) ||
+      (pRsp[2 + T1T_NMN] != T1T_MAGIC_NUMBER))
+    return false;
+
+  RW_NDEF_TLV_Init(&pNdef->Tlv, T1T_DATA_AREA,
+                   (pRsp[2 + T1T_TMS] + 1) * T1T_BLOCK_SZ, true);
+  RW_NDEF_TLV_Reserve(&pNdef->Tlv, T1T_RESERVED, T1T_RESERVED_SZ);
+  return true;
 }
 
-void RW_NDEF_T1T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                           unsigned char *pCmd, unsigned short *pCmd_size) {
+/* Read what the TLV parser needs next: the whole segment with RSEG when more
+ * than a block of message is left, else a single block with READ8 */
+static void RW_NDEF_T1T_ReadMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                 unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+  unsigned short Next = RW_NDEF_TLV_Next(&pNdef->Tlv);
+
+  /* Static memory tags are read at once by RALL */
+  if (T1T_IS_STATIC(pNdef->HR0))
+    return;
+
+  pNdef->Segment = RW_NDEF_TLV_Needed(&pNdef->Tlv) > T1T_BLOCK_SZ;
+  if (pNdef->Segment) {
+    RW_NDEF_T1T_Command(pNdef, T1T_RSEG, sizeof(T1T_RSEG), pCmd, pCmd_size);
+    pCmd[1] = (Next / T1T_SEGMENT_SZ) << 4;
+    pNdef->BlkNb = (Next / T1T_SEGMENT_SZ) * (T1T_SEGMENT_SZ / T1T_BLOCK_SZ);
+  } else {
+    RW_NDEF_T1T_Command(pNdef, T1T_READ8, sizeof(T1T_READ8), pCmd, pCmd_size);
+    pNdef->BlkNb = Next / T1T_BLOCK_SZ;
+    pCmd[1] = pNdef->BlkNb;
+  }
+}
+
+/* Feed the READ8 or RSEG answer to the TLV parser */
+static unsigned char RW_NDEF_T1T_Parse(RW_NDEF_Context_t *pCtx,
+                                       unsigned char *pRsp,
+                                       unsigned short Rsp_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+  unsigned short Size = pNdef->Segment ? T1T_SEGMENT_SZ : T1T_BLOCK_SZ;
+
+  /* Is Read success ?*/
+  if ((Rsp_size != Size + 2) || (pRsp[Rsp_size - 1] != 0x00))
+    return RW_NDEF_TLV_FAILED;
+
+  return RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, pNdef->BlkNb * T1T_BLOCK_SZ,
+                           &pRsp[1], Size);
+}
+
+void RW_NDEF_T1T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T1T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Send T1T_RID */
     memcpy(pCmd, T1T_RID, sizeof(T1T_RID));
     *pCmd_size = 7;
-    eRW_NDEF_T1T_State = Getting_ID;
+    pCtx->State = Getting_ID;
     break;
 
   case Getting_ID:
-    /* Is CC Read and Is Ndef ?*/
-    if ((Rsp_size == 7) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Fill File structure */
-      RW_NDEF_T1T_Ndef.HR0 = pRsp[0];
-      RW_NDEF_T1T_Ndef.HR1 = pRsp[1];
-      memcpy(RW_NDEF_T1T_Ndef.UID, &pRsp[2], sizeof(RW_NDEF_T1T_Ndef.UID));
-
-      /* Read full card content */
-      memcpy(pCmd, T1T_RALL, sizeof(T1T_RALL));
-      memcpy(&pCmd[3], RW_NDEF_T1T_Ndef.UID, sizeof(RW_NDEF_T1T_Ndef.UID));
-      *pCmd_size = sizeof(T1T_RALL) + sizeof(RW_NDEF_T1T_Ndef.UID);
-      eRW_NDEF_T1T_State = Reading_CardContent;
+    RW_NDEF_T1T_GettingID(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    break;
+
+  case Reading_CardContent:
+    if (RW_NDEF_T1T_CardContent(pCtx, pRsp, Rsp_size) &&
+        (RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, 0, &pRsp[2], T1T_RALL_SZ) ==
+         RW_NDEF_TLV_MORE)) {
+      RW_NDEF_T1T_ReadMore(pCtx, pCmd, pCmd_size);
+      pCtx->State = Reading_NDEF;
     }
     break;
 
+  case Reading_NDEF:
+    if (RW_NDEF_T1T_Parse(pCtx, pRsp, Rsp_size) == RW_NDEF_TLV_MORE)
+      RW_NDEF_T1T_ReadMore(pCtx, pCmd, pCmd_size);
+    break;
+
+  default:
+    break;
+  }
+}
+
+/* Next address of the data area after Address */
+static unsigned short RW_NDEF_T1T_NextAddress(RW_NDEF_T1T_Ndef_t *pNdef,
+                                              unsigned short Address) {
+  do
+    Address++;
+  while ((Address < pNdef->Tlv.End) &&
+         RW_NDEF_TLV_Reserved(&pNdef->Tlv, Address));
+  return Address;
+}
+
+/* Write the message TLVs at the place found by the TLV parser. The NDEF magic
+ * number is cleared first and set again last, so that the tag shows no
+ * message while it is being written */
+static void RW_NDEF_T1T_StartWrite(RW_NDEF_Context_t *pCtx,
+                                   unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+  unsigned short Address = RW_NDEF_TLV_Next(&pNdef->Tlv);
+  unsigned short Space = RW_NDEF_TLV_Space(&pNdef->Tlv, Address);
+
+  /* Beyond the first segment only whole blocks can be written (WRITE-E8) */
+  if ((Address >= T1T_SEGMENT_SZ) && ((Address % T1T_BLOCK_SZ) != 0))
+    return;
+  for (unsigned char i = 0; i < pNdef->Tlv.Areas; i++) {
+    if ((pNdef->Tlv.AreaStart[i] + pNdef->Tlv.AreaSize[i] > T1T_SEGMENT_SZ) &&
+        (((pNdef->Tlv.AreaStart[i] % T1T_BLOCK_SZ) != 0) ||
+         ((pNdef->Tlv.AreaSize[i] % T1T_BLOCK_SZ) != 0)))
+      return;
+  }
+
+  /* Is size enough ? */
+  pNdef->ImageSize = RW_NDEF_TLV_ImageSize(pCtx);
+  if (pNdef->ImageSize > Space)
+    return;
+  /* Terminate the TLVs if there is room left */
+  if (pNdef->ImageSize < Space)
+    pNdef->ImageSize++;
+
+  pNdef->Address = Address;
+  pNdef->MessagePtr = 0;
+
+  RW_NDEF_T1T_Command(pNdef, T1T_WRITE_E, sizeof(T1T_WRITE_E), pCmd,
+                      pCmd_size);
+  pCmd[1] = T1T_NMN;
+  pCmd[2] = 0x00;
+  pCtx->State = Clearing_NMN;
+}
+
+/* Write the image from Address on: a whole block with WRITE-E8 when it holds
+ * image bytes only on a dynamic memory tag, else a single byte with WRITE-E */
+static void RW_NDEF_T1T_WriteMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+  unsigned short Address = pNdef->Address;
+  bool Block = !T1T_IS_STATIC(pNdef->HR0) &&
+               ((Address % T1T_BLOCK_SZ) == 0) &&
+               (Address + T1T_BLOCK_SZ <= pNdef->Tlv.End);
+
+  for (unsigned char i = 0; Block && (i < T1T_BLOCK_SZ); i++) {
+    if (RW_NDEF_TLV_Reserved(&pNdef->Tlv, Address + i))
+      Block = false;
+  }
+
+  if (Block) {
+    RW_NDEF_T1T_Command(pNdef, T1T_WRITE_E8, sizeof(T1T_WRITE_E8), pCmd,
+                        pCmd_size);
+    pCmd[1] = Address / T1T_BLOCK_SZ;
+    for (unsigned char i = 0; i < T1T_BLOCK_SZ; i++)
+      pCmd[2 + i] = RW_NDEF_TLV_ImageByte(pCtx, pNdef->MessagePtr + i,
+                                          pNdef->ImageSize);
+    pNdef->Chunk = T1T_BLOCK_SZ;
+  } else {
+    RW_NDEF_T1T_Command(pNdef, T1T_WRITE_E, sizeof(T1T_WRITE_E), pCmd,
+                        pCmd_size);
+    pCmd[1] = Address;
+    pCmd[2] =
+        RW_NDEF_TLV_ImageByte(pCtx, pNdef->MessagePtr, pNdef->ImageSize);
+    pNdef->Chunk = 1;
+  }
+}
+
+void RW_NDEF_T1T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size) {
+  RW_NDEF_T1T_Ndef_t *pNdef = &pCtx->Tag.T1T;
+  unsigned char Status;
+
+  /* By default no further command to be sent */
+  *pCmd_size = 0;
+
+  switch (pCtx->State) {
+  case Initial:
+    /* Send T1T_RID */
+    memcpy(pCmd, T1T_RID, sizeof(T1T_RID));
+    *pCmd_size = 7;
+    pCtx->State = Getting_ID;
+    break;
+
+  case Getting_ID:
+    RW_NDEF_T1T_GettingID(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    break;
+
   case Reading_CardContent:
-    /* Is Read success ?*/
-    if ((Rsp_size == 123) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Check CC */
-      if (pRsp[10] == T1T_MAGIC_NUMBER) {
-        unsigned char Tmp = 14;
-        unsigned char data_size;
-
-        /* If not NDEF Type skip TLV */
-        while (pRsp[Tmp] != T1T_NDEF_TLV) {
-          Tmp += 2 + pRsp[Tmp + 1];
-          if (Tmp > Rsp_size)
-            return;
-        }
-
-        RW_NDEF_T1T_Ndef.MessageSize = pRsp[Tmp + 1];
-        data_size = (Rsp_size - 1) - 16 - Tmp - 2;
-
-        /* If provisioned buffer is not large enough, notify the application and
-         * stop reading */
-        if (RW_NDEF_T1T_Ndef.MessageSize > RW_MAX_NDEF_FILE_SIZE) {
-          if (pRW_NDEF_PullCb != NULL)
-            pRW_NDEF_PullCb(NULL, 0);
-          break;
-        }
-
-        /* Is NDEF read already completed ? */
-        if (RW_NDEF_T1T_Ndef.MessageSize <= data_size) {
-          memcpy(RW_NDEF_T1T_Ndef.pMessage, &pRsp[Tmp + 2],
-                 RW_NDEF_T1T_Ndef.MessageSize);
-
-          /* Notify application of the NDEF reception */
-          if (pRW_NDEF_PullCb != NULL)
-            pRW_NDEF_PullCb(RW_NDEF_T1T_Ndef.pMessage,
-                            RW_NDEF_T1T_Ndef.MessageSize);
-        } else {
-          RW_NDEF_T1T_Ndef.MessagePtr = data_size;
-          memcpy(RW_NDEF_T1T_Ndef.pMessage, &pRsp[Tmp + 2],
-                 RW_NDEF_T1T_Ndef.MessagePtr);
-          RW_NDEF_T1T_Ndef.BlkNb = 0x10;
-
-          /* Read NDEF content */
-          memcpy(pCmd, T1T_READ8, sizeof(T1T_READ8));
-          pCmd[1] = RW_NDEF_T1T_Ndef.BlkNb;
-          memcpy(&pCmd[10], RW_NDEF_T1T_Ndef.UID, sizeof(RW_NDEF_T1T_Ndef.UID));
-          *pCmd_size = sizeof(T1T_READ8) + sizeof(RW_NDEF_T1T_Ndef.UID);
-
-          eRW_NDEF_T1T_State = Reading_NDEF;
-        }
-      }
+    /* Is tag R/W ? */
+    if (RW_NDEF_T1T_CardContent(pCtx, pRsp, Rsp_size) &&
+        (pRsp[2 + T1T_RWA] == 0x00)) {
+      RW_NDEF_TLV_Locate(&pNdef->Tlv);
+      Status = RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, 0, &pRsp[2], T1T_RALL_SZ);
+      if (Status == RW_NDEF_TLV_MORE) {
+        RW_NDEF_T1T_ReadMore(pCtx, pCmd, pCmd_size);
+        pCtx->State = Reading_NDEF;
+      } else if (Status == RW_NDEF_TLV_DONE)
+        RW_NDEF_T1T_StartWrite(pCtx, pCmd, pCmd_size);
     }
     break;
 
   case Reading_NDEF:
-    /* Is Read success ?*/
-    if ((Rsp_size == 10) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF read already completed ? */
-      if ((RW_NDEF_T1T_Ndef.MessageSize - RW_NDEF_T1T_Ndef.MessagePtr) < 8) {
-        memcpy(&RW_NDEF_T1T_Ndef.pMessage[RW_NDEF_T1T_Ndef.MessagePtr],
-               &pRsp[1],
-               RW_NDEF_T1T_Ndef.MessageSize - RW_NDEF_T1T_Ndef.MessagePtr);
-
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(RW_NDEF_T1T_Ndef.pMessage,
-                          RW_NDEF_T1T_Ndef.MessageSize);
-      } else {
-        memcpy(&RW_NDEF_T1T_Ndef.pMessage[RW_NDEF_T1T_Ndef.MessagePtr],
-               &pRsp[1], 8);
-        RW_NDEF_T1T_Ndef.MessagePtr += 8;
-        RW_NDEF_T1T_Ndef.BlkNb++;
-
-        /* Read NDEF content */
-        memcpy(pCmd, T1T_READ8, sizeof(T1T_READ8));
-        pCmd[1] = RW_NDEF_T1T_Ndef.BlkNb;
-        memcpy(&pCmd[10], RW_NDEF_T1T_Ndef.UID, sizeof(RW_NDEF_T1T_Ndef.UID));
-        *pCmd_size = sizeof(T1T_READ8) + sizeof(RW_NDEF_T1T_Ndef.UID);
+    Status = RW_NDEF_T1T_Parse(pCtx, pRsp, Rsp_size);
+    if (Status == RW_NDEF_TLV_MORE)
+      RW_NDEF_T1T_ReadMore(pCtx, pCmd, pCmd_size);
+    else if (Status == RW_NDEF_TLV_DONE)
+      RW_NDEF_T1T_StartWrite(pCtx, pCmd, pCmd_size);
+    break;
+
+  case Clearing_NMN:
+    /* Is Write success ?*/
+    if ((Rsp_size == 3) && (pRsp[Rsp_size - 1] == 0x00)) {
+      RW_NDEF_T1T_WriteMore(pCtx, pCmd, pCmd_size);
+      pCtx->State = Writing_Data;
+    }
+    break;
+
+  case Writing_Data:
+    /* Is Write success ?*/
+    if ((Rsp_size == pNdef->Chunk + 2) && (pRsp[Rsp_size - 1] == 0x00)) {
+      pNdef->MessagePtr += pNdef->Chunk;
+      pNdef->Address = RW_NDEF_T1T_NextAddress(
+          pNdef, pNdef->Address + pNdef->Chunk - 1);
+
+      if (pNdef->MessagePtr < pNdef->ImageSize)
+        RW_NDEF_T1T_WriteMore(pCtx, pCmd, pCmd_size);
+      else {
+        /* Set the NDEF magic number back, no erase needed from 00h */
+        RW_NDEF_T1T_Command(pNdef, T1T_WRITE_NE, sizeof(T1T_WRITE_NE), pCmd,
+                            pCmd_size);
+        pCmd[1] = T1T_NMN;
+        pCmd[2] = T1T_MAGIC_NUMBER;
+        pCtx->State = Setting_NMN;
       }
     }
     break;
 
+  case Setting_NMN:
+    /* Is Write success ?*/
+    if ((Rsp_size == 3) && (pRsp[Rsp_size - 1] == 0x00)) {
+      /* Notify application of the NDEF send completion */
+      if (pCtx->pPushCb != NULL)
+        pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
+    }
+    break;
+
   default:
     break;
   }
@@ -15,138 +15,397 @@
 // #ifdef RW_SUPPORT
 // #ifndef NO_NDEF_SUPPORT
 #include "RW_NDEF.h"
+#include "RW_NDEF_TLV.h"
 #include "tool.h"
 
-/* TODO: No support for tag larger than 1024 bytes (requiring SECTOR_SELECT
- * command use) */
+/* Blocks are addressed linearly (sector * 256 + page) to reach tags larger
+ * than 1024 bytes, the SECTOR_SELECT command is sent when the sector changes */
 
 #define T2T_MAGIC_NUMBER 0xE1
 #define T2T_NDEF_TLV 0x03
+#define T2T_DATA_AREA 16
+#define T2T_READ 0x30
+#define T2T_FAST_READ 0x3A
+#define T2T_WRITE 0xA2
+#define T2T_SECTOR_SELECT 0xC2
+#define T2T_ACK 0x0A
+#define T2T_PAGE_SZ 4
+#define T2T_TERMINATOR_TLV 0xFE
+#define T2T_FIRST_PAGE (T2T_DATA_AREA / T2T_PAGE_SZ)
+#define T2T_NULL_TLV 0x00
 
 typedef enum {
   Initial,
   Reading_CC,
-  Reading_Data,
   Reading_NDEF,
-  Writing_Data
+  Comparing_Data,
+  Clearing_Length,
+  Writing_Data,
+  Writing_Length,
+  Selecting_Sector,
+  Selected_Sector,
+  Reading_Page,
+  Completed
 } RW_NDEF_T2T_state_t;
 
-typedef struct {
-  unsigned char BlkNb;
-  unsigned short MessagePtr;
-  unsigned short MessageSize;
-  unsigned char *pMessage;
-} RW_NDEF_T2T_Ndef_t;
+void RW_NDEF_T2T_Reset(RW_NDEF_Context_t *pCtx) {
+  pCtx->State = Initial;
+  pCtx->Tag.T2T.Sector = 0;
+  pCtx->Tag.T2T.FastRead = false;
+  pCtx->Tag.T2T.Compare = false;
+}
+
+/* To be called after RW_NDEF_T2T_Reset, only for tags known to support
+ * FAST_READ (NTAG21x, MIFARE Ultralight EV1) */
+void RW_NDEF_T2T_SetFastRead(RW_NDEF_Context_t *pCtx, bool FastRead) {
+  pCtx->Tag.T2T.FastRead = FastRead;
+}
+
+/* To be called after RW_NDEF_T2T_Reset: the write first reads the NDEF area
+ * and only writes the pages that differ */
+void RW_NDEF_T2T_SetCompare(RW_NDEF_Context_t *pCtx, bool Compare) {
+  pCtx->Tag.T2T.Compare = Compare;
+}
+
+/* Is page (from the data area start) to be written ? Pages beyond the
+ * compare bitmap always are */
+static bool RW_NDEF_T2T_Dirty(RW_NDEF_T2T_Ndef_t *pNdef, unsigned short Page) {
+  if (Page >= RW_NDEF_T2T_COMPARE_PAGES)
+    return true;
+  return (pNdef->Dirty[Page / 8] & (1 << (Page % 8))) != 0;
+}
+
+static void RW_NDEF_T2T_SetDirty(RW_NDEF_T2T_Ndef_t *pNdef, unsigned short Page,
+                                 bool Dirty) {
+  if (Page >= RW_NDEF_T2T_COMPARE_PAGES)
+    return;
+  if (Dirty)
+    pNdef->Dirty[Page / 8] |= 1 << (Page % 8);
+  else
+    pNdef->Dirty[Page / 8] &= ~(1 << (Page % 8));
+}
+
+/* Image offset of the data area byte at Address (not before the NDEF TLV),
+ * reserved bytes hold no image */
+static unsigned short RW_NDEF_T2T_Offset(RW_NDEF_T2T_Ndef_t *pNdef,
+                                         unsigned short Address) {
+  unsigned short Offset = Address - pNdef->Address;
+
+  for (unsigned char i = 0; i < pNdef->Tlv.Areas; i++) {
+    unsigned short Start = pNdef->Tlv.AreaStart[i];
+    unsigned short End = Start + pNdef->Tlv.AreaSize[i];
+
+    if (Start < pNdef->Address)
+      Start = pNdef->Address;
+    if (End > Address)
+      End = Address;
+    if (End > Start)
+      Offset -= End - Start;
+  }
+  return Offset;
+}
+
+/* Is image Offset part of the NDEF length value (0xFF marker excluded) ? */
+static bool RW_NDEF_T2T_LengthValue(RW_NDEF_Context_t *pCtx,
+                                    unsigned short Offset) {
+  unsigned char Size = RW_NDEF_TLV_LengthSize(pCtx);
+
+  return (Offset <= Size) && (Offset >= ((Size == 3) ? 2 : 1));
+}
+
+/* Is Address written with the image ? Bytes ahead of the NDEF TLV and
+ * reserved bytes are kept as they are */
+static bool RW_NDEF_T2T_Image(RW_NDEF_T2T_Ndef_t *pNdef,
+                              unsigned short Address) {
+  return (Address >= pNdef->Address) &&
+         !RW_NDEF_TLV_Reserved(&pNdef->Tlv, Address);
+}
+
+/* Is Address the NULL TLV added ahead of the NDEF TLV ? */
+static bool RW_NDEF_T2T_Pad(RW_NDEF_T2T_Ndef_t *pNdef,
+                            unsigned short Address) {
+  return pNdef->Pad && (Address + 1 == pNdef->Address);
+}
+
+/* Number of bytes of page BlkNb which are kept as they are */
+static unsigned char RW_NDEF_T2T_Kept(RW_NDEF_T2T_Ndef_t *pNdef,
+                                      unsigned short BlkNb) {
+  unsigned char Kept = 0;
+
+  for (unsigned char i = 0; i < T2T_PAGE_SZ; i++) {
+    if (!RW_NDEF_T2T_Image(pNdef, BlkNb * T2T_PAGE_SZ + i))
+      Kept++;
+  }
+  return Kept;
+}
+
+/* Byte to write at Address: kept bytes as read (page PageBlk), else the image
+ * with a zero NDEF length while clearing */
+static unsigned char RW_NDEF_T2T_Byte(RW_NDEF_Context_t *pCtx,
+                                      unsigned short Address) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+  unsigned short Offset;
 
-static RW_NDEF_T2T_state_t eRW_NDEF_T2T_State = Initial;
-static RW_NDEF_T2T_Ndef_t RW_NDEF_T2T_Ndef;
+  if (RW_NDEF_T2T_Pad(pNdef, Address))
+    return T2T_NULL_TLV;
+  if (!RW_NDEF_T2T_Image(pNdef, Address))
+    return pNdef->Page[Address % T2T_PAGE_SZ];
 
-void RW_NDEF_T2T_Reset(void) {
-  eRW_NDEF_T2T_State = Initial;
-  RW_NDEF_T2T_Ndef.pMessage = NdefBuffer;
+  Offset = RW_NDEF_T2T_Offset(pNdef, Address);
+  if ((pCtx->State == Clearing_Length) &&
+      RW_NDEF_T2T_LengthValue(pCtx, Offset))
+    return 0x00;
+  return RW_NDEF_TLV_ImageByte(pCtx, Offset, pNdef->ImageSize);
 }
 
-void RW_NDEF_T2T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                           unsigned char *pCmd, unsigned short *pCmd_size) {
+/* Compare the pages read at block BlkNb with the data to write */
+static void RW_NDEF_T2T_Compare(RW_NDEF_Context_t *pCtx, unsigned char *pData,
+                                unsigned short Pages) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  for (unsigned short i = 0; i < Pages; i++) {
+    unsigned short Page = pNdef->BlkNb + i;
+    bool Dirty = false;
+
+    for (unsigned char j = 0; j < T2T_PAGE_SZ; j++) {
+      unsigned short Address = Page * T2T_PAGE_SZ + j;
+
+      /* Kept bytes and the padding after the image are not compared */
+      if ((RW_NDEF_T2T_Pad(pNdef, Address) ||
+           (RW_NDEF_T2T_Image(pNdef, Address) &&
+            (RW_NDEF_T2T_Offset(pNdef, Address) < pNdef->ImageSize))) &&
+          (RW_NDEF_T2T_Byte(pCtx, Address) != pData[i * T2T_PAGE_SZ + j]))
+        Dirty = true;
+    }
+    RW_NDEF_T2T_SetDirty(pNdef, Page - T2T_FIRST_PAGE, Dirty);
+  }
+}
+
+/* First data page to write from block BlkNb on, 0 if none. The page of the
+ * NDEF length and wholly reserved pages are left out */
+static unsigned short RW_NDEF_T2T_NextDirty(RW_NDEF_T2T_Ndef_t *pNdef,
+                                            unsigned short BlkNb) {
+  for (; BlkNb <= pNdef->LastBlk; BlkNb++) {
+    if ((BlkNb != pNdef->LengthBlk) &&
+        (RW_NDEF_T2T_Kept(pNdef, BlkNb) < T2T_PAGE_SZ) &&
+        RW_NDEF_T2T_Dirty(pNdef, BlkNb - T2T_FIRST_PAGE))
+      return BlkNb;
+  }
+  return 0;
+}
+
+/* Build the command reading from block BlkNb on: a FAST_READ covering as
+ * much of the Needed bytes (unknown if 0) as fits in one NCI data packet
+ * (response data plus status byte) and in the sector, or a plain 4-page READ */
+static void RW_NDEF_T2T_ReadMore(RW_NDEF_Context_t *pCtx,
+                                 unsigned short Needed, unsigned char *pCmd,
+                                 unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  if (pNdef->FastRead) {
+    unsigned short MaxPayload =
+        (pCtx->MaxPayload != 0) ? pCtx->MaxPayload : 0xFF;
+    unsigned short Pages = (Needed != 0)
+                               ? (Needed + T2T_PAGE_SZ - 1) / T2T_PAGE_SZ
+                               : 4;
+
+    if (Pages > (MaxPayload - 1) / T2T_PAGE_SZ)
+      Pages = (MaxPayload - 1) / T2T_PAGE_SZ;
+    if (Pages > 0x100 - (pNdef->BlkNb & 0xFF))
+      Pages = 0x100 - (pNdef->BlkNb & 0xFF);
+    pNdef->Pages = Pages;
+
+    pCmd[0] = T2T_FAST_READ;
+    pCmd[1] = pNdef->BlkNb & 0xFF;
+    pCmd[2] = (pNdef->BlkNb + pNdef->Pages - 1) & 0xFF;
+    *pCmd_size = 3;
+  } else {
+    pNdef->Pages = 4;
+
+    pCmd[0] = T2T_READ;
+    pCmd[1] = pNdef->BlkNb & 0xFF;
+    *pCmd_size = 2;
+  }
+}
+
+/* Build the WRITE of block BlkNb, with a zero NDEF length while clearing */
+static void RW_NDEF_T2T_WriteMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  pCmd[0] = T2T_WRITE;
+  pCmd[1] = pNdef->BlkNb & 0xFF;
+  for (unsigned char i = 0; i < T2T_PAGE_SZ; i++)
+    pCmd[2 + i] = RW_NDEF_T2T_Byte(pCtx, pNdef->BlkNb * T2T_PAGE_SZ + i);
+  *pCmd_size = 6;
+}
+
+/* Build the next command of the operation in progress (pCtx->State), first
+ * switching to the sector of block BlkNb if needed. SECTOR_SELECT takes two
+ * packets: the first one is ACKed, the second one is accepted by the tag
+ * staying silent */
+static void RW_NDEF_T2T_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                             unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  if ((pNdef->BlkNb >> 8) != pNdef->Sector) {
+    pCmd[0] = T2T_SECTOR_SELECT;
+    pCmd[1] = 0xFF;
+    *pCmd_size = 2;
+    pNdef->Resume = pCtx->State;
+    pCtx->State = Selecting_Sector;
+  } else if (pCtx->State == Reading_NDEF)
+    RW_NDEF_T2T_ReadMore(pCtx, RW_NDEF_TLV_Needed(&pNdef->Tlv), pCmd,
+                         pCmd_size);
+  else if (pCtx->State == Comparing_Data)
+    RW_NDEF_T2T_ReadMore(pCtx,
+                         (pNdef->LastBlk + 1 - pNdef->BlkNb) * T2T_PAGE_SZ,
+                         pCmd, pCmd_size);
+  else if ((pCtx->State == Clearing_Length) ||
+           (pCtx->State == Writing_Data) || (pCtx->State == Writing_Length)) {
+    /* Other bytes share the page with the image, read them to keep them */
+    if ((pNdef->BlkNb != pNdef->PageBlk) &&
+        (RW_NDEF_T2T_Kept(pNdef, pNdef->BlkNb) != 0)) {
+      pCmd[0] = T2T_READ;
+      pCmd[1] = pNdef->BlkNb & 0xFF;
+      *pCmd_size = 2;
+      pNdef->Resume = pCtx->State;
+      pCtx->State = Reading_Page;
+    } else
+      RW_NDEF_T2T_WriteMore(pCtx, pCmd, pCmd_size);
+  }
+}
+
+/* Once the operation is over, go back to sector 0 so that the next one
+ * starts from the CC as expected */
+static void RW_NDEF_T2T_Complete(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                 unsigned short *pCmd_size) {
+  pCtx->Tag.T2T.BlkNb = 0;
+  pCtx->State = Completed;
+  RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+}
+
+/* Write the pages that changed. When data pages follow, the NDEF length is
+ * cleared first and written last, so that an interrupted write leaves an
+ * empty message rather than a partial one */
+static void RW_NDEF_T2T_StartWrite(RW_NDEF_Context_t *pCtx,
+                                   unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  if (RW_NDEF_T2T_NextDirty(pNdef, pNdef->Address / T2T_PAGE_SZ) != 0)
+    pCtx->State = Clearing_Length;
+  else if (RW_NDEF_T2T_Dirty(pNdef, pNdef->LengthBlk - T2T_FIRST_PAGE))
+    pCtx->State = Writing_Length;
+  else {
+    /* Tag already holds the message */
+    if (pCtx->pPushCb != NULL)
+      pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
+    RW_NDEF_T2T_Complete(pCtx, pCmd, pCmd_size);
+    return;
+  }
+
+  pNdef->BlkNb = pNdef->LengthBlk;
+  RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+}
+
+/* SECTOR_SELECT states, common to read and write */
+static void RW_NDEF_T2T_SectorSelect(RW_NDEF_Context_t *pCtx,
+                                     unsigned char *pRsp,
+                                     unsigned short Rsp_size,
+                                     unsigned char *pCmd,
+                                     unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  if (pCtx->State == Selecting_Sector) {
+    /* Is first packet ACKed ? */
+    if ((Rsp_size == 2) && (pRsp[0] == T2T_ACK) &&
+        (pRsp[Rsp_size - 1] == 0x00)) {
+      pCmd[0] = pNdef->BlkNb >> 8;
+      pCmd[1] = 0x00;
+      pCmd[2] = 0x00;
+      pCmd[3] = 0x00;
+      *pCmd_size = 4;
+      pCtx->State = Selected_Sector;
+    }
+  } else {
+    /* The tag accepts the sector by staying silent, reported by the driver as
+     * an empty answer (RF timeout). Any other answer but an ACK is a NAK */
+    if ((Rsp_size == 0) ||
+        ((Rsp_size == 2) && (pRsp[0] == T2T_ACK) && (pRsp[1] == 0x00))) {
+      pNdef->Sector = pNdef->BlkNb >> 8;
+      pCtx->State = pNdef->Resume;
+      RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+    }
+  }
+}
+
+/* Read the block holding the next byte the TLV parser needs, if any */
+static void RW_NDEF_T2T_Parsed(RW_NDEF_Context_t *pCtx, unsigned char Status,
+                               unsigned char *pCmd,
+                               unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
+  if (Status == RW_NDEF_TLV_MORE) {
+    pNdef->BlkNb = RW_NDEF_TLV_Next(&pNdef->Tlv) / T2T_PAGE_SZ;
+    pCtx->State = Reading_NDEF;
+    RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+  } else
+    RW_NDEF_T2T_Complete(pCtx, pCmd, pCmd_size);
+}
+
+void RW_NDEF_T2T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T2T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Read CC */
     pCmd[0] = 0x30;
     pCmd[1] = 0x03;
     *pCmd_size = 2;
-    eRW_NDEF_T2T_State = Reading_CC;
+    pCtx->State = Reading_CC;
     break;
 
   case Reading_CC:
     /* Is CC Read and Is Ndef ?*/
     if ((Rsp_size == 17) && (pRsp[Rsp_size - 1] == 0x00) &&
         (pRsp[0] == T2T_MAGIC_NUMBER)) {
-      /* Read First data */
-      pCmd[0] = 0x30;
-      pCmd[1] = 0x04;
-      *pCmd_size = 2;
-
-      eRW_NDEF_T2T_State = Reading_Data;
+      /* The CC read also returns the first 12 bytes of the data area */
+      RW_NDEF_TLV_Init(&pNdef->Tlv, T2T_DATA_AREA,
+                       T2T_DATA_AREA + pRsp[2] * 8, true);
+      RW_NDEF_T2T_Parsed(pCtx,
+                         RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, T2T_DATA_AREA,
+                                           &pRsp[4], 12),
+                         pCmd, pCmd_size);
     }
     break;
 
-  case Reading_Data:
+  case Reading_NDEF:
     /* Is Read success ?*/
-    if ((Rsp_size == 17) && (pRsp[Rsp_size - 1] == 0x00)) {
-      unsigned char Tmp = 0;
-      /* If not NDEF Type skip TLV */
-      while (pRsp[Tmp] != T2T_NDEF_TLV) {
-        Tmp += 2 + pRsp[Tmp + 1];
-        if (Tmp > Rsp_size)
-          return;
-      }
+    if ((Rsp_size == pNdef->Pages * T2T_PAGE_SZ + 1) &&
+        (pRsp[Rsp_size - 1] == 0x00)) {
+      unsigned short Size = Rsp_size - 1;
 
-      if (pRsp[Tmp + 1] == 0xFF) {
-        RW_NDEF_T2T_Ndef.MessageSize = (pRsp[Tmp + 2] << 8) + pRsp[Tmp + 3];
-        Tmp += 2;
-      } else
-        RW_NDEF_T2T_Ndef.MessageSize = pRsp[Tmp + 1];
-
-      /* If provisioned buffer is not large enough or message is empty, notify
-       * the application and stop reading */
-      if ((RW_NDEF_T2T_Ndef.MessageSize > RW_MAX_NDEF_FILE_SIZE) ||
-          (RW_NDEF_T2T_Ndef.MessageSize == 0)) {
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(NULL, 0);
-        break;
-      }
+      /* READ rolls over at the end of the sector */
+      if (pNdef->Pages > 0x100 - (pNdef->BlkNb & 0xFF))
+        Size = (0x100 - (pNdef->BlkNb & 0xFF)) * T2T_PAGE_SZ;
 
-      /* Is NDEF read already completed ? */
-      if (RW_NDEF_T2T_Ndef.MessageSize <= ((Rsp_size - 1) - Tmp - 2)) {
-        memcpy(RW_NDEF_T2T_Ndef.pMessage, &pRsp[Tmp + 2],
-               RW_NDEF_T2T_Ndef.MessageSize);
-
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(RW_NDEF_T2T_Ndef.pMessage,
-                          RW_NDEF_T2T_Ndef.MessageSize);
-      } else {
-        RW_NDEF_T2T_Ndef.MessagePtr = (Rsp_size - 1) - Tmp - 2;
-        memcpy(RW_NDEF_T2T_Ndef.pMessage, &pRsp[Tmp + 2],
-               RW_NDEF_T2T_Ndef.MessagePtr);
-        RW_NDEF_T2T_Ndef.BlkNb = 8;
-
-        /* Read NDEF content */
-        pCmd[0] = 0x30;
-        pCmd[1] = RW_NDEF_T2T_Ndef.BlkNb;
-        *pCmd_size = 2;
-        eRW_NDEF_T2T_State = Reading_NDEF;
-      }
+      RW_NDEF_T2T_Parsed(pCtx,
+                         RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv,
+                                           pNdef->BlkNb * T2T_PAGE_SZ, pRsp,
+                                           Size),
+                         pCmd, pCmd_size);
     }
     break;
 
-  case Reading_NDEF:
-    /* Is Read success ?*/
-    if ((Rsp_size == 17) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF read already completed ? */
-      if ((RW_NDEF_T2T_Ndef.MessageSize - RW_NDEF_T2T_Ndef.MessagePtr) < 16) {
-        memcpy(&RW_NDEF_T2T_Ndef.pMessage[RW_NDEF_T2T_Ndef.MessagePtr], pRsp,
-               RW_NDEF_T2T_Ndef.MessageSize - RW_NDEF_T2T_Ndef.MessagePtr);
-
-        /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(RW_NDEF_T2T_Ndef.pMessage,
-                          RW_NDEF_T2T_Ndef.MessageSize);
-      } else {
-        memcpy(&RW_NDEF_T2T_Ndef.pMessage[RW_NDEF_T2T_Ndef.MessagePtr], pRsp,
-               16);
-        RW_NDEF_T2T_Ndef.MessagePtr += 16;
-        RW_NDEF_T2T_Ndef.BlkNb += 4;
-
-        /* Read NDEF content */
-        pCmd[0] = 0x30;
-        pCmd[1] = RW_NDEF_T2T_Ndef.BlkNb;
-        *pCmd_size = 2;
-      }
-    }
+  case Selecting_Sector:
+  case Selected_Sector:
+    RW_NDEF_T2T_SectorSelect(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
     break;
 
   default:
@@ -154,68 +413,225 @@ void RW_NDEF_T2T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
   }
 }
 
-void RW_NDEF_T2T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                            unsigned char *pCmd, unsigned short *pCmd_size) {
+/* Lay the image out from the place found by the TLV parser, pData holds the
+ * Pages pages read from block BlkNb on. Returns false if the message does not
+ * fit */
+static bool RW_NDEF_T2T_Layout(RW_NDEF_Context_t *pCtx, unsigned char *pData,
+                               unsigned short Pages) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+  unsigned short Address = RW_NDEF_TLV_Next(&pNdef->Tlv);
+  unsigned short Space = RW_NDEF_TLV_Space(&pNdef->Tlv, Address);
+  unsigned short First = Address / T2T_PAGE_SZ;
+  unsigned char LengthSize = RW_NDEF_TLV_LengthSize(pCtx);
+  unsigned short Last;
+
+  /* A 3 bytes length starting on the last byte of a page would be committed
+   * by two writes, a NULL TLV moves the NDEF TLV one byte on */
+  pNdef->Pad = (LengthSize == 3) && ((Address % T2T_PAGE_SZ) == 1);
+
+  /* Is size enough ? */
+  pNdef->ImageSize = RW_NDEF_TLV_ImageSize(pCtx);
+  if (pNdef->ImageSize + (pNdef->Pad ? 1 : 0) > Space)
+    return false;
+  if (pNdef->Pad) {
+    Address++;
+    Space--;
+  }
+  /* Terminate the TLVs if there is room left */
+  if (pNdef->ImageSize < Space)
+    pNdef->ImageSize++;
+  pNdef->Address = Address;
+
+  /* Pages of the NDEF length and of the last image byte */
+  Last = Address;
+  for (unsigned short Offset = 1; Offset < pNdef->ImageSize; Offset++) {
+    do
+      Last++;
+    while (RW_NDEF_TLV_Reserved(&pNdef->Tlv, Last));
+    if (Offset == ((LengthSize == 3) ? 2 : 1))
+      pNdef->LengthBlk = Last / T2T_PAGE_SZ;
+  }
+  pNdef->LastBlk = Last / T2T_PAGE_SZ;
+
+  /* Keep the first page when it was just read, else it is read when needed */
+  pNdef->PageBlk = 0;
+  if ((First >= pNdef->BlkNb) && (First < pNdef->BlkNb + Pages)) {
+    memcpy(pNdef->Page, &pData[(First - pNdef->BlkNb) * T2T_PAGE_SZ],
+           T2T_PAGE_SZ);
+    pNdef->PageBlk = First;
+  }
+
+  memset(pNdef->Dirty, 0xFF, sizeof(pNdef->Dirty));
+  return true;
+}
+
+/* Read the block holding the next byte the TLV parser needs to find the place
+ * of the NDEF TLV. Once found, the Pages pages read at block BlkNb (pData) are
+ * compared with the image if requested and the write starts */
+static void RW_NDEF_T2T_Located(RW_NDEF_Context_t *pCtx, unsigned char Status,
+                                unsigned char *pData, unsigned short Pages,
+                                unsigned char *pCmd,
+                                unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+  unsigned short First;
+
+  if (Status == RW_NDEF_TLV_MORE) {
+    pNdef->BlkNb = RW_NDEF_TLV_Next(&pNdef->Tlv) / T2T_PAGE_SZ;
+    pCtx->State = Reading_NDEF;
+    RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+    return;
+  }
+  /* Only NULL TLVs after the control TLVs, the NDEF TLV goes in their place */
+  if ((Status == RW_NDEF_TLV_FAILED) &&
+      (RW_NDEF_TLV_Next(&pNdef->Tlv) < pNdef->Tlv.End))
+    Status = RW_NDEF_TLV_DONE;
+  if ((Status != RW_NDEF_TLV_DONE) ||
+      !RW_NDEF_T2T_Layout(pCtx, pData, Pages)) {
+    RW_NDEF_T2T_Complete(pCtx, pCmd, pCmd_size);
+    return;
+  }
+
+  if (pNdef->Compare) {
+    /* Pages already read from the NDEF TLV on */
+    First = pNdef->Address / T2T_PAGE_SZ;
+    if ((First >= pNdef->BlkNb) && (First < pNdef->BlkNb + Pages)) {
+      Pages -= First - pNdef->BlkNb;
+      pData += (First - pNdef->BlkNb) * T2T_PAGE_SZ;
+    } else
+      Pages = 0;
+    pNdef->BlkNb = First;
+    if (Pages > pNdef->LastBlk + 1 - First)
+      Pages = pNdef->LastBlk + 1 - First;
+    RW_NDEF_T2T_Compare(pCtx, pData, Pages);
+    pNdef->BlkNb += Pages;
+    pCtx->State = Comparing_Data;
+    if ((pNdef->BlkNb <= pNdef->LastBlk) &&
+        ((pNdef->BlkNb - T2T_FIRST_PAGE) < RW_NDEF_T2T_COMPARE_PAGES)) {
+      RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+      return;
+    }
+  }
+  RW_NDEF_T2T_StartWrite(pCtx, pCmd, pCmd_size);
+}
+
+void RW_NDEF_T2T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size) {
+  RW_NDEF_T2T_Ndef_t *pNdef = &pCtx->Tag.T2T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T2T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Read CC */
     pCmd[0] = 0x30;
     pCmd[1] = 0x03;
     *pCmd_size = 2;
-    eRW_NDEF_T2T_State = Reading_CC;
+    pCtx->State = Reading_CC;
     break;
 
   case Reading_CC:
     /* Is CC Read, Is Ndef and is R/W ?*/
     if ((Rsp_size == 17) && (pRsp[Rsp_size - 1] == 0x00) &&
         (pRsp[0] == T2T_MAGIC_NUMBER) && (pRsp[3] == 0x00)) {
-      /* Is size enough ? */
-      if (pRsp[2] * 8 >= RW_NdefMessage_size) {
-        /* Write First data */
-        pCmd[0] = 0xA2;
-        pCmd[1] = 0x04;
-        pCmd[2] = 0x03;
-        if (RW_NdefMessage_size > 0xFF) {
-          pCmd[3] = 0xFF;
-          pCmd[4] = (RW_NdefMessage_size & 0xFF00) >> 8;
-          pCmd[5] = RW_NdefMessage_size & 0xFF;
-          RW_NDEF_T2T_Ndef.MessagePtr = 0;
-        } else {
-          pCmd[3] = (unsigned char)RW_NdefMessage_size;
-          memcpy(&pCmd[4], pRW_NdefMessage, 2);
-          RW_NDEF_T2T_Ndef.MessagePtr = 2;
-        }
-        RW_NDEF_T2T_Ndef.BlkNb = 5;
-        *pCmd_size = 6;
-        eRW_NDEF_T2T_State = Writing_Data;
-      }
+      /* Lock and Memory Control TLVs are kept, the NDEF TLV is written after
+       * them. The CC read also returns the first 3 pages of the data area */
+      RW_NDEF_TLV_Init(&pNdef->Tlv, T2T_DATA_AREA,
+                       T2T_DATA_AREA + pRsp[2] * 8, true);
+      RW_NDEF_TLV_Locate(&pNdef->Tlv);
+      pNdef->BlkNb = T2T_FIRST_PAGE;
+      RW_NDEF_T2T_Located(pCtx,
+                          RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv, T2T_DATA_AREA,
+                                            &pRsp[4], 12),
+                          &pRsp[4], 3, pCmd, pCmd_size);
+    }
+    break;
+
+  case Reading_NDEF:
+    /* Is Read success ?*/
+    if ((Rsp_size == pNdef->Pages * T2T_PAGE_SZ + 1) &&
+        (pRsp[Rsp_size - 1] == 0x00)) {
+      unsigned short Pages = pNdef->Pages;
+
+      /* READ rolls over at the end of the sector */
+      if (Pages > 0x100 - (pNdef->BlkNb & 0xFF))
+        Pages = 0x100 - (pNdef->BlkNb & 0xFF);
+
+      RW_NDEF_T2T_Located(pCtx,
+                          RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv,
+                                            pNdef->BlkNb * T2T_PAGE_SZ, pRsp,
+                                            Pages * T2T_PAGE_SZ),
+                          pRsp, Pages, pCmd, pCmd_size);
     }
     break;
 
+  case Comparing_Data:
+    /* Is Read success ?*/
+    if ((Rsp_size == pNdef->Pages * T2T_PAGE_SZ + 1) &&
+        (pRsp[Rsp_size - 1] == 0x00)) {
+      unsigned short Pages = pNdef->Pages;
+
+      /* READ rolls over at the end of the sector */
+      if (Pages > 0x100 - (pNdef->BlkNb & 0xFF))
+        Pages = 0x100 - (pNdef->BlkNb & 0xFF);
+
+      RW_NDEF_T2T_Compare(pCtx, pRsp, Pages);
+      pNdef->BlkNb += Pages;
+
+      /* Is the whole NDEF area compared ? */
+      if ((pNdef->BlkNb <= pNdef->LastBlk) &&
+          ((pNdef->BlkNb - T2T_FIRST_PAGE) < RW_NDEF_T2T_COMPARE_PAGES))
+        RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+      else
+        RW_NDEF_T2T_StartWrite(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Clearing_Length:
   case Writing_Data:
     /* Is Write success ?*/
     if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
-      /* Is NDEF write already completed ? */
-      if (RW_NdefMessage_size <= RW_NDEF_T2T_Ndef.MessagePtr) {
-        /* Notify application of the NDEF send completion */
-        if (pRW_NDEF_PushCb != NULL)
-          pRW_NDEF_PushCb(pRW_NdefMessage, RW_NdefMessage_size);
-      } else {
-        /* Write NDEF content */
-        pCmd[0] = 0xA2;
-        pCmd[1] = RW_NDEF_T2T_Ndef.BlkNb;
-        memcpy(&pCmd[2], pRW_NdefMessage + RW_NDEF_T2T_Ndef.MessagePtr, 4);
-        *pCmd_size = 6;
-
-        RW_NDEF_T2T_Ndef.MessagePtr += 4;
-        RW_NDEF_T2T_Ndef.BlkNb++;
+      pNdef->BlkNb = RW_NDEF_T2T_NextDirty(
+          pNdef, (pCtx->State == Clearing_Length)
+                     ? pNdef->Address / T2T_PAGE_SZ
+                     : pNdef->BlkNb + 1);
+      if (pNdef->BlkNb != 0)
+        pCtx->State = Writing_Data;
+      else {
+        /* Commit the NDEF length */
+        pNdef->BlkNb = pNdef->LengthBlk;
+        pCtx->State = Writing_Length;
       }
+      RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
     }
     break;
 
+  case Writing_Length:
+    /* Is Write success ?*/
+    if ((Rsp_size == 2) && (pRsp[Rsp_size - 1] == 0x00)) {
+      /* Notify application of the NDEF send completion */
+      if (pCtx->pPushCb != NULL)
+        pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
+      RW_NDEF_T2T_Complete(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Reading_Page:
+    /* Is Read success ?*/
+    if ((Rsp_size == 4 * T2T_PAGE_SZ + 1) && (pRsp[Rsp_size - 1] == 0x00)) {
+      memcpy(pNdef->Page, pRsp, T2T_PAGE_SZ);
+      pNdef->PageBlk = pNdef->BlkNb;
+      pCtx->State = pNdef->Resume;
+      RW_NDEF_T2T_Next(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Selecting_Sector:
+  case Selected_Sector:
+    RW_NDEF_T2T_SectorSelect(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    break;
+
   default:
     break;
   }
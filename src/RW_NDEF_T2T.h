@@ -12,8 +12,12 @@
  *                          arising from its use.
  */
 
-void RW_NDEF_T2T_Reset(void);
-void RW_NDEF_T2T_Read_Next(unsigned char *pCmd, unsigned short Cmd_size,
-                           unsigned char *Rsp, unsigned short *pRsp_size);
-void RW_NDEF_T2T_Write_Next(unsigned char *pCmd, unsigned short Cmd_size,
-                            unsigned char *Rsp, unsigned short *pRsp_size);
+void RW_NDEF_T2T_Reset(RW_NDEF_Context_t *pCtx);
+void RW_NDEF_T2T_SetFastRead(RW_NDEF_Context_t *pCtx, bool FastRead);
+void RW_NDEF_T2T_SetCompare(RW_NDEF_Context_t *pCtx, bool Compare);
+void RW_NDEF_T2T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                           unsigned short Cmd_size, unsigned char *Rsp,
+                           unsigned short *pRsp_size);
+void RW_NDEF_T2T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                            unsigned short Cmd_size, unsigned char *Rsp,
+                            unsigned short *pRsp_size);
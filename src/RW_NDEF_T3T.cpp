@@ -20,96 +20,198 @@
 #define T3T_MAGIC_NUMBER 0xE1
 #define T3T_NDEF_TLV 0x03
 
-unsigned char T3T_Check[] = {0x10, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                             0x00, 0x00, 0x01, 0x0B, 0x00, 0x1,  0x80, 0x00};
+#define T3T_BLOCK_SZ 16
+/* Length byte, response code, IDm, status flags and number of blocks */
+#define T3T_CHECK_RSP_HEADER 13
+#define T3T_UPDATE_RSP_SZ 12
+#define T3T_CHECK 0x06
+#define T3T_UPDATE 0x08
+
+/* Attribute Information Block fields */
+#define T3T_AIB_NBR 1
+#define T3T_AIB_NBW 2
+#define T3T_AIB_NMAXB 3
+#define T3T_AIB_WRITEF 9
+#define T3T_AIB_RWFLAG 10
+#define T3T_AIB_LN 11
+#define T3T_AIB_CHECKSUM 14
+#define T3T_WRITEF_ON 0x0F
+#define T3T_RWFLAG_RW 0x01
+
+/* CHECK command template, the IDm is filled in from the context. The block
+ * list and the length byte are completed per command */
+const unsigned char T3T_Check[] = {0x10, 0x06, 0x00, 0x00, 0x00, 0x00,
+                                   0x00, 0x00, 0x00, 0x00, 0x01, 0x0B,
+                                   0x00, 0x1,  0x80, 0x00};
+/* UPDATE command template, NDEF write service */
+const unsigned char T3T_Update[] = {0x00, 0x08, 0x00, 0x00, 0x00,
+                                    0x00, 0x00, 0x00, 0x00, 0x00,
+                                    0x01, 0x09, 0x00, 0x01};
 
 typedef enum {
   Initial,
   Getting_AttributeInfo,
-  Reading_CardContent
+  Reading_CardContent,
+  Writing_AttributeInfo,
+  Writing_Data,
+  Committing_AttributeInfo
 } RW_NDEF_T3T_state_t;
 
-typedef struct {
-  unsigned char IDm[8];
-  unsigned char BlkNb;
-  unsigned short Ptr;
-  unsigned short Size;
-  unsigned char *p;
-} RW_NDEF_T3T_Ndef_t;
+void RW_NDEF_T3T_Reset(RW_NDEF_Context_t *pCtx) { pCtx->State = Initial; }
+
+void RW_NDEF_T3T_SetIDm(RW_NDEF_Context_t *pCtx, const unsigned char *pIDm) {
+  memcpy(pCtx->Tag.T3T.IDm, pIDm, sizeof(pCtx->Tag.T3T.IDm));
+}
+
+/* Build a CHECK (T3T_Check) or UPDATE (T3T_Update) command of Blocks blocks
+ * from block BlkNb on. Returns the offset of the block data, if any */
+static unsigned short RW_NDEF_T3T_Command(RW_NDEF_T3T_Ndef_t *pNdef,
+                                          const unsigned char *pTemplate,
+                                          unsigned short BlkNb,
+                                          unsigned char Blocks,
+                                          unsigned char *pCmd,
+                                          unsigned short *pCmd_size) {
+  unsigned short Size = 14;
+
+  memcpy(pCmd, pTemplate, Size);
+  memcpy(&pCmd[2], pNdef->IDm, sizeof(pNdef->IDm));
+  pCmd[13] = Blocks;
+
+  /* 2-byte block list elements, 3-byte ones beyond block 255 */
+  for (unsigned char i = 0; i < Blocks; i++, BlkNb++) {
+    if (BlkNb <= 0xFF) {
+      pCmd[Size++] = 0x80;
+      pCmd[Size++] = BlkNb;
+    } else {
+      pCmd[Size++] = 0x00;
+      pCmd[Size++] = BlkNb & 0xFF;
+      pCmd[Size++] = BlkNb >> 8;
+    }
+  }
+
+  if (pTemplate[1] == T3T_UPDATE)
+    pCmd[0] = Size + Blocks * T3T_BLOCK_SZ;
+  else
+    pCmd[0] = Size;
+  *pCmd_size = pCmd[0];
+  return Size;
+}
+
+/* Is the CHECK or UPDATE answered with success ? */
+static bool RW_NDEF_T3T_Success(unsigned char *pRsp, unsigned short Rsp_size,
+                                unsigned char Code) {
+  return (Rsp_size > T3T_UPDATE_RSP_SZ) && (pRsp[Rsp_size - 1] == 0x00) &&
+         (pRsp[1] == Code + 1) && (pRsp[10] == 0x00) && (pRsp[11] == 0x00);
+}
+
+static unsigned short RW_NDEF_T3T_Checksum(const unsigned char *pAttr) {
+  unsigned short Sum = 0;
+
+  for (unsigned char i = 0; i < T3T_AIB_CHECKSUM; i++)
+    Sum += pAttr[i];
+  return Sum;
+}
 
-static RW_NDEF_T3T_state_t eRW_NDEF_T3T_State = Initial;
-static RW_NDEF_T3T_Ndef_t RW_NDEF_T3T_Ndef;
+/* Most blocks per command: the Nbr or Nbw of the tag, within one NCI data
+ * packet (CHECK response with status byte, or UPDATE command with its block
+ * list) */
+static unsigned char RW_NDEF_T3T_Blocks(RW_NDEF_Context_t *pCtx,
+                                        unsigned char Nb, unsigned short Left,
+                                        bool Update) {
+  unsigned short MaxPayload =
+      (pCtx->MaxPayload != 0) ? pCtx->MaxPayload : 0xFF;
+  unsigned short Blocks = (Left + T3T_BLOCK_SZ - 1) / T3T_BLOCK_SZ;
+  unsigned short Frame =
+      Update ? (MaxPayload - 14) / (T3T_BLOCK_SZ + 3)
+             : (MaxPayload - T3T_CHECK_RSP_HEADER - 1) / T3T_BLOCK_SZ;
 
-void RW_NDEF_T3T_Reset(void) {
-  eRW_NDEF_T3T_State = Initial;
-  RW_NDEF_T3T_Ndef.p = NdefBuffer;
+  if (Nb == 0)
+    Nb = 1;
+  if (Blocks > Nb)
+    Blocks = Nb;
+  if (Blocks > Frame)
+    Blocks = Frame;
+  return Blocks;
 }
 
-void RW_NDEF_T3T_SetIDm(unsigned char *pIDm) {
-  memcpy(RW_NDEF_T3T_Ndef.IDm, pIDm, sizeof(RW_NDEF_T3T_Ndef.IDm));
-  memcpy(&T3T_Check[2], pIDm, sizeof(RW_NDEF_T3T_Ndef.IDm));
+/* CHECK the next blocks of the NDEF message */
+static void RW_NDEF_T3T_ReadMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                 unsigned short *pCmd_size) {
+  RW_NDEF_T3T_Ndef_t *pNdef = &pCtx->Tag.T3T;
+
+  pNdef->Blocks =
+      RW_NDEF_T3T_Blocks(pCtx, pNdef->Nbr, pNdef->Size - pNdef->Ptr, false);
+  (void)RW_NDEF_T3T_Command(pNdef, T3T_Check, pNdef->BlkNb, pNdef->Blocks,
+                            pCmd, pCmd_size);
 }
 
-void RW_NDEF_T3T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                           unsigned char *pCmd, unsigned short *pCmd_size) {
+void RW_NDEF_T3T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size) {
+  RW_NDEF_T3T_Ndef_t *pNdef = &pCtx->Tag.T3T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T3T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Get AttributeInfo */
-    memcpy(pCmd, T3T_Check, sizeof(T3T_Check));
-    *pCmd_size = sizeof(T3T_Check);
-    eRW_NDEF_T3T_State = Getting_AttributeInfo;
+    (void)RW_NDEF_T3T_Command(pNdef, T3T_Check, 0, 1, pCmd, pCmd_size);
+    pCtx->State = Getting_AttributeInfo;
     break;
 
   case Getting_AttributeInfo:
     /* Is Check success ?*/
-    if ((pRsp[Rsp_size - 1] == 0x00) && (pRsp[1] == 0x07) &&
-        (pRsp[10] == 0x00) && (pRsp[11] == 0x00)) {
+    if (RW_NDEF_T3T_Success(pRsp, Rsp_size, T3T_CHECK) &&
+        (Rsp_size == T3T_CHECK_RSP_HEADER + T3T_BLOCK_SZ + 1)) {
+      unsigned char *pAttr = &pRsp[T3T_CHECK_RSP_HEADER];
+
       /* Fill File structure */
-      RW_NDEF_T3T_Ndef.Size = (pRsp[24] << 16) + (pRsp[25] << 16) + pRsp[26];
-
-      /* If provisioned buffer is not large enough or size is null, notify the
-       * application and stop reading */
-      if ((RW_NDEF_T3T_Ndef.Size > RW_MAX_NDEF_FILE_SIZE) ||
-          (RW_NDEF_T3T_Ndef.Size == 0)) {
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(NULL, 0);
+      pNdef->Nbr = pAttr[T3T_AIB_NBR];
+      pNdef->Size = (pAttr[T3T_AIB_LN + 1] << 8) + pAttr[T3T_AIB_LN + 2];
+
+      /* If provisioned buffer is not large enough, size is null or larger
+       * than 64kB, the Attribute Information is corrupted or a write was
+       * interrupted, notify the application and stop reading */
+      if (!RW_NDEF_Fits(pCtx, pNdef->Size) || (pNdef->Size == 0) ||
+          (pAttr[T3T_AIB_LN] != 0) ||
+          (RW_NDEF_T3T_Checksum(pAttr) !=
+           (pAttr[T3T_AIB_CHECKSUM] << 8) + pAttr[T3T_AIB_CHECKSUM + 1]) ||
+          (pAttr[T3T_AIB_WRITEF] == T3T_WRITEF_ON)) {
+        RW_NDEF_Notify(pCtx, NULL, 0);
         break;
       }
 
-      RW_NDEF_T3T_Ndef.Ptr = 0;
-      RW_NDEF_T3T_Ndef.BlkNb = 1;
+      pNdef->Ptr = 0;
+      pNdef->BlkNb = 1;
 
-      /* Read first NDEF block */
-      memcpy(pCmd, T3T_Check, sizeof(T3T_Check));
-      pCmd[15] = 0x01;
-      *pCmd_size = sizeof(T3T_Check);
-      eRW_NDEF_T3T_State = Reading_CardContent;
+      /* Read first NDEF blocks */
+      RW_NDEF_T3T_ReadMore(pCtx, pCmd, pCmd_size);
+      pCtx->State = Reading_CardContent;
     }
     break;
 
   case Reading_CardContent:
     /* Is Check success ?*/
-    if ((pRsp[Rsp_size - 1] == 0x00) && (pRsp[1] == 0x07) &&
-        (pRsp[10] == 0x00) && (pRsp[11] == 0x00)) {
+    if (RW_NDEF_T3T_Success(pRsp, Rsp_size, T3T_CHECK) &&
+        (Rsp_size ==
+         T3T_CHECK_RSP_HEADER + pNdef->Blocks * T3T_BLOCK_SZ + 1)) {
+      unsigned short Size = pNdef->Blocks * T3T_BLOCK_SZ;
+
       /* Is NDEF message read completed ?*/
-      if ((RW_NDEF_T3T_Ndef.Size - RW_NDEF_T3T_Ndef.Ptr) <= 16) {
-        memcpy(&RW_NDEF_T3T_Ndef.p[RW_NDEF_T3T_Ndef.Ptr], &pRsp[13],
-               (RW_NDEF_T3T_Ndef.Size - RW_NDEF_T3T_Ndef.Ptr));
+      if ((pNdef->Size - pNdef->Ptr) <= Size) {
+        RW_NDEF_Store(pCtx, pNdef->Ptr, &pRsp[T3T_CHECK_RSP_HEADER],
+                      pNdef->Size - pNdef->Ptr, pNdef->Size);
         /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(RW_NDEF_T3T_Ndef.p, RW_NDEF_T3T_Ndef.Size);
+        RW_NDEF_Notify(pCtx, pCtx->pBuffer, pNdef->Size);
       } else {
-        memcpy(&RW_NDEF_T3T_Ndef.p[RW_NDEF_T3T_Ndef.Ptr], &pRsp[13], 16);
-        RW_NDEF_T3T_Ndef.Ptr += 16;
-        RW_NDEF_T3T_Ndef.BlkNb++;
-
-        /* Read next NDEF block */
-        memcpy(pCmd, T3T_Check, sizeof(T3T_Check));
-        pCmd[15] = RW_NDEF_T3T_Ndef.BlkNb;
-        *pCmd_size = sizeof(T3T_Check);
+        RW_NDEF_Store(pCtx, pNdef->Ptr, &pRsp[T3T_CHECK_RSP_HEADER], Size,
+                      pNdef->Size);
+        pNdef->Ptr += Size;
+        pNdef->BlkNb += pNdef->Blocks;
+
+        /* Read next NDEF blocks */
+        RW_NDEF_T3T_ReadMore(pCtx, pCmd, pCmd_size);
       }
     }
     break;
@@ -118,5 +220,118 @@ void RW_NDEF_T3T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
     break;
   }
 }
+
+/* UPDATE the Attribute Information Block with WriteF and Ln set */
+static void RW_NDEF_T3T_WriteAttr(RW_NDEF_T3T_Ndef_t *pNdef,
+                                  unsigned char WriteF, unsigned short Size,
+                                  unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  unsigned char *pAttr = pNdef->Attr;
+  unsigned short Sum;
+
+  pAttr[T3T_AIB_WRITEF] = WriteF;
+  pAttr[T3T_AIB_LN] = 0x00;
+  pAttr[T3T_AIB_LN + 1] = Size >> 8;
+  pAttr[T3T_AIB_LN + 2] = Size & 0xFF;
+  Sum = RW_NDEF_T3T_Checksum(pAttr);
+  pAttr[T3T_AIB_CHECKSUM] = Sum >> 8;
+  pAttr[T3T_AIB_CHECKSUM + 1] = Sum & 0xFF;
+
+  memcpy(&pCmd[RW_NDEF_T3T_Command(pNdef, T3T_Update, 0, 1, pCmd,
+                                   pCmd_size)],
+         pAttr, T3T_BLOCK_SZ);
+}
+
+/* UPDATE the next blocks of the NDEF message, the last one zero padded */
+static void RW_NDEF_T3T_WriteMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_T3T_Ndef_t *pNdef = &pCtx->Tag.T3T;
+  unsigned short Left = pCtx->MessageSize - pNdef->Ptr;
+  unsigned short Offset;
+
+  pNdef->Blocks = RW_NDEF_T3T_Blocks(pCtx, pNdef->Nbw, Left, true);
+  Offset = RW_NDEF_T3T_Command(pNdef, T3T_Update, pNdef->BlkNb, pNdef->Blocks,
+                               pCmd, pCmd_size);
+  if (Left > pNdef->Blocks * T3T_BLOCK_SZ)
+    Left = pNdef->Blocks * T3T_BLOCK_SZ;
+  memset(&pCmd[Offset], 0x00, pNdef->Blocks * T3T_BLOCK_SZ);
+  memcpy(&pCmd[Offset], pCtx->pMessage + pNdef->Ptr, Left);
+}
+
+void RW_NDEF_T3T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size) {
+  RW_NDEF_T3T_Ndef_t *pNdef = &pCtx->Tag.T3T;
+
+  /* By default no further command to be sent */
+  *pCmd_size = 0;
+
+  switch (pCtx->State) {
+  case Initial:
+    /* Get AttributeInfo */
+    (void)RW_NDEF_T3T_Command(pNdef, T3T_Check, 0, 1, pCmd, pCmd_size);
+    pCtx->State = Getting_AttributeInfo;
+    break;
+
+  case Getting_AttributeInfo:
+    /* Is Check success, is tag R/W and is size enough ?*/
+    if (RW_NDEF_T3T_Success(pRsp, Rsp_size, T3T_CHECK) &&
+        (Rsp_size == T3T_CHECK_RSP_HEADER + T3T_BLOCK_SZ + 1)) {
+      unsigned char *pAttr = &pRsp[T3T_CHECK_RSP_HEADER];
+      unsigned long Nmaxb =
+          (pAttr[T3T_AIB_NMAXB] << 8) + pAttr[T3T_AIB_NMAXB + 1];
+
+      if ((pAttr[T3T_AIB_RWFLAG] != T3T_RWFLAG_RW) ||
+          (Nmaxb * T3T_BLOCK_SZ < pCtx->MessageSize))
+        break;
+
+      memcpy(pNdef->Attr, pAttr, T3T_BLOCK_SZ);
+      pNdef->Nbw = pAttr[T3T_AIB_NBW];
+
+      /* Flag the write in progress, the current length is kept */
+      RW_NDEF_T3T_WriteAttr(
+          pNdef, T3T_WRITEF_ON,
+          (pAttr[T3T_AIB_LN + 1] << 8) + pAttr[T3T_AIB_LN + 2], pCmd,
+          pCmd_size);
+      pCtx->State = Writing_AttributeInfo;
+    }
+    break;
+
+  case Writing_AttributeInfo:
+  case Writing_Data:
+    /* Is Update success ?*/
+    if (RW_NDEF_T3T_Success(pRsp, Rsp_size, T3T_UPDATE)) {
+      if (pCtx->State == Writing_AttributeInfo) {
+        pNdef->Ptr = 0;
+        pNdef->BlkNb = 1;
+        pCtx->State = Writing_Data;
+      } else {
+        pNdef->Ptr += pNdef->Blocks * T3T_BLOCK_SZ;
+        pNdef->BlkNb += pNdef->Blocks;
+      }
+
+      /* Is NDEF message written ? Then commit its length */
+      if (pNdef->Ptr >= pCtx->MessageSize) {
+        RW_NDEF_T3T_WriteAttr(pNdef, 0x00, pCtx->MessageSize, pCmd,
+                              pCmd_size);
+        pCtx->State = Committing_AttributeInfo;
+      } else
+        RW_NDEF_T3T_WriteMore(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Committing_AttributeInfo:
+    /* Is Update success ?*/
+    if (RW_NDEF_T3T_Success(pRsp, Rsp_size, T3T_UPDATE)) {
+      /* Notify application of the NDEF send completion */
+      if (pCtx->pPushCb != NULL)
+        pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
 // #endif
 // #endif
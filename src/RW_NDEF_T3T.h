@@ -12,7 +12,11 @@
  *                          arising from its use.
  */
 
-void RW_NDEF_T3T_Reset(void);
-void RW_NDEF_T3T_SetIDm(unsigned char *pIDm);
-void RW_NDEF_T3T_Read_Next(unsigned char *pCmd, unsigned short Cmd_size,
-                           unsigned char *Rsp, unsigned short *pRsp_size);
+void RW_NDEF_T3T_Reset(RW_NDEF_Context_t *pCtx);
+void RW_NDEF_T3T_SetIDm(RW_NDEF_Context_t *pCtx, const unsigned char *pIDm);
+void RW_NDEF_T3T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                           unsigned short Cmd_size, unsigned char *Rsp,
+                           unsigned short *pRsp_size);
+void RW_NDEF_T3T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                            unsigned short Cmd_size, unsigned char *Rsp,
+                            unsigned short *pRsp_size);
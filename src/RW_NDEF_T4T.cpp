@@ -28,10 +28,28 @@ const unsigned char RW_NDEF_T4T_NDEF_Select[] = {0x00, 0xA4, 0x00, 0x0C,
                                                  0x02, 0xE1, 0x04};
 const unsigned char RW_NDEF_T4T_Read[] = {0x00, 0xB0, 0x00, 0x00, 0x0F};
 const unsigned char RW_NDEF_T4T_Write[] = {0x00, 0xD6, 0x00, 0x00, 0x00};
+/* Same commands addressing the file with an offset data object */
+const unsigned char RW_NDEF_T4T_ReadOdo[] = {0x00, 0xB1, 0x00, 0x00,
+                                             0x05, 0x54, 0x03, 0x00,
+                                             0x00, 0x00, 0x00};
+const unsigned char RW_NDEF_T4T_WriteOdo[] = {0x00, 0xD7, 0x00, 0x00, 0x00,
+                                              0x54, 0x03, 0x00, 0x00, 0x00};
 
 const unsigned char RW_NDEF_T4T_OK[] = {0x90, 0x00};
 
-#define WRITE_SZ 54
+#define T4T_NDEF_FILE_CTRL_TLV 0x04
+#define T4T_ENDEF_FILE_CTRL_TLV 0x06
+
+/* CLA INS P1 P2 Lc of an UPDATE BINARY */
+#define T4T_HEADER_SZ 5
+/* SW1 SW2 ending a response */
+#define T4T_SW_SZ 2
+/* Offset data object */
+#define T4T_ODO_SZ 5
+/* Discretionary data object header, tag and BER length */
+#define T4T_DDO_SZ(size) (((size) < 0x80) ? 2 : 3)
+/* Largest offset P1-P2 can carry, ODO is needed beyond */
+#define T4T_MAX_OFFSET 0x7FFF
 
 typedef enum {
   Initial,
@@ -47,38 +65,151 @@ typedef enum {
   Write_NDEFcomplete
 } RW_NDEF_T4T_state_t;
 
-typedef struct {
-  unsigned char MappingVersion;
-  unsigned short MLe;
-  unsigned short MLc;
-  unsigned char FileID[2];
-  unsigned short MaxNdefFileSize;
-  unsigned char RdAccess;
-  unsigned char WrAccess;
-  unsigned short MessagePtr;
-  unsigned short MessageSize;
-  unsigned char *pMessage;
-} RW_NDEF_T4T_Ndef_t;
-
-static RW_NDEF_T4T_state_t eRW_NDEF_T4T_State = Initial;
-static RW_NDEF_T4T_Ndef_t RW_NDEF_T4T_Ndef;
-
-void RW_NDEF_T4T_Reset(void) {
-  eRW_NDEF_T4T_State = Initial;
-  RW_NDEF_T4T_Ndef.pMessage = NdefBuffer;
+void RW_NDEF_T4T_Reset(RW_NDEF_Context_t *pCtx) { pCtx->State = Initial; }
+
+static unsigned short RW_NDEF_T4T_MaxPayload(RW_NDEF_Context_t *pCtx) {
+  return (pCtx->MaxPayload != 0) ? pCtx->MaxPayload : 0xFF;
+}
+
+/* Largest READ BINARY allowed by the card MLe and by a single data packet */
+static unsigned char RW_NDEF_T4T_ReadSize(RW_NDEF_Context_t *pCtx) {
+  RW_NDEF_T4T_Ndef_t *pNdef = &pCtx->Tag.T4T;
+  unsigned short Size = RW_NDEF_T4T_MaxPayload(pCtx) - T4T_SW_SZ;
+
+  if ((pNdef->MLe != 0) && (pNdef->MLe < Size))
+    Size = pNdef->MLe;
+  if (pNdef->NlenSize + pNdef->MessagePtr > T4T_MAX_OFFSET)
+    Size -= T4T_DDO_SZ(0xFF);
+  if (pNdef->MessageSize - pNdef->MessagePtr < Size)
+    Size = pNdef->MessageSize - pNdef->MessagePtr;
+  return (unsigned char)Size;
+}
+
+/* Largest UPDATE BINARY allowed by the card MLc and by a single data packet */
+static unsigned char RW_NDEF_T4T_WriteSize(RW_NDEF_Context_t *pCtx) {
+  RW_NDEF_T4T_Ndef_t *pNdef = &pCtx->Tag.T4T;
+  unsigned short Size = RW_NDEF_T4T_MaxPayload(pCtx) - T4T_HEADER_SZ;
+
+  if ((pNdef->MLc != 0) && (pNdef->MLc < Size))
+    Size = pNdef->MLc;
+  if (pNdef->NlenSize + pNdef->MessagePtr > T4T_MAX_OFFSET)
+    Size -= T4T_ODO_SZ + T4T_DDO_SZ(0xFF);
+  if (pCtx->MessageSize - pNdef->MessagePtr < Size)
+    Size = pCtx->MessageSize - pNdef->MessagePtr;
+  return (unsigned char)Size;
+}
+
+static void RW_NDEF_T4T_ReadBinary(unsigned long Offset, unsigned char Size,
+                                   unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  if (Offset <= T4T_MAX_OFFSET) {
+    memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
+    pCmd[2] = Offset >> 8;
+    pCmd[3] = Offset & 0xFF;
+    pCmd[4] = Size;
+    *pCmd_size = sizeof(RW_NDEF_T4T_Read);
+  } else {
+    memcpy(pCmd, RW_NDEF_T4T_ReadOdo, sizeof(RW_NDEF_T4T_ReadOdo));
+    pCmd[7] = (Offset >> 16) & 0xFF;
+    pCmd[8] = (Offset >> 8) & 0xFF;
+    pCmd[9] = Offset & 0xFF;
+    pCmd[10] = Size + T4T_DDO_SZ(Size);
+    *pCmd_size = sizeof(RW_NDEF_T4T_ReadOdo);
+  }
+}
+
+static void RW_NDEF_T4T_UpdateBinary(unsigned long Offset,
+                                     unsigned char *pData, unsigned char Size,
+                                     unsigned char *pCmd,
+                                     unsigned short *pCmd_size) {
+  unsigned char Ptr;
+
+  if (Offset <= T4T_MAX_OFFSET) {
+    memcpy(pCmd, RW_NDEF_T4T_Write, sizeof(RW_NDEF_T4T_Write));
+    pCmd[2] = Offset >> 8;
+    pCmd[3] = Offset & 0xFF;
+    pCmd[4] = Size;
+    Ptr = sizeof(RW_NDEF_T4T_Write);
+  } else {
+    memcpy(pCmd, RW_NDEF_T4T_WriteOdo, sizeof(RW_NDEF_T4T_WriteOdo));
+    pCmd[7] = (Offset >> 16) & 0xFF;
+    pCmd[8] = (Offset >> 8) & 0xFF;
+    pCmd[9] = Offset & 0xFF;
+    Ptr = sizeof(RW_NDEF_T4T_WriteOdo);
+    /* Data wrapped in a discretionary data object */
+    pCmd[Ptr++] = 0x53;
+    if (Size >= 0x80)
+      pCmd[Ptr++] = 0x81;
+    pCmd[Ptr++] = Size;
+    pCmd[4] = Ptr - T4T_HEADER_SZ + Size;
+  }
+  memcpy(&pCmd[Ptr], pData, Size);
+  *pCmd_size = Ptr + Size;
+}
+
+/* Parse the CC, a mapping 3.0 ENDEF File Control TLV needs 2 more bytes */
+static void RW_NDEF_T4T_Reading_CC(RW_NDEF_Context_t *pCtx,
+                                   unsigned char *pRsp,
+                                   unsigned short Rsp_size,
+                                   unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  RW_NDEF_T4T_Ndef_t *pNdef = &pCtx->Tag.T4T;
+
+  /* Is CC Read ?*/
+  if ((Rsp_size < 15 + 2) ||
+      memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK)))
+    return;
+
+  if ((pRsp[7] == T4T_ENDEF_FILE_CTRL_TLV) && (Rsp_size < 17 + 2)) {
+    /* Read the whole CC again */
+    RW_NDEF_T4T_ReadBinary(0, 17, pCmd, pCmd_size);
+    return;
+  }
+
+  /* Fill CC structure */
+  pNdef->MappingVersion = pRsp[2];
+  pNdef->MLe = (pRsp[3] << 8) + pRsp[4];
+  pNdef->MLc = (pRsp[5] << 8) + pRsp[6];
+  pNdef->FileID[0] = pRsp[9];
+  pNdef->FileID[1] = pRsp[10];
+  if (pRsp[7] == T4T_ENDEF_FILE_CTRL_TLV) {
+    pNdef->MaxNdefFileSize = ((unsigned long)pRsp[11] << 24) +
+                             ((unsigned long)pRsp[12] << 16) +
+                             (pRsp[13] << 8) + pRsp[14];
+    pNdef->RdAccess = pRsp[15];
+    pNdef->WrAccess = pRsp[16];
+    pNdef->NlenSize = 4;
+  } else {
+    pNdef->MaxNdefFileSize = (pRsp[11] << 8) + pRsp[12];
+    pNdef->RdAccess = pRsp[13];
+    pNdef->WrAccess = pRsp[14];
+    pNdef->NlenSize = 2;
+  }
+
+  /* Select NDEF */
+  memcpy(pCmd, RW_NDEF_T4T_NDEF_Select, sizeof(RW_NDEF_T4T_NDEF_Select));
+  if (pNdef->MappingVersion == 0x10)
+    pCmd[3] = 0x00;
+  pCmd[5] = pNdef->FileID[0];
+  pCmd[6] = pNdef->FileID[1];
+  *pCmd_size = sizeof(RW_NDEF_T4T_NDEF_Select);
+  pCtx->State = Selecting_NDEF;
 }
 
-void RW_NDEF_T4T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                           unsigned char *pCmd, unsigned short *pCmd_size) {
+void RW_NDEF_T4T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size) {
+  RW_NDEF_T4T_Ndef_t *pNdef = &pCtx->Tag.T4T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T4T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Select NDEF Application in version 2.0 */
     memcpy(pCmd, RW_NDEF_T4T_APP_Select20, sizeof(RW_NDEF_T4T_APP_Select20));
     *pCmd_size = sizeof(RW_NDEF_T4T_APP_Select20);
-    eRW_NDEF_T4T_State = Selecting_NDEF_Application20;
+    pCtx->State = Selecting_NDEF_Application20;
     break;
 
   case Selecting_NDEF_Application20:
@@ -87,12 +218,12 @@ void RW_NDEF_T4T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
       /* Select CC */
       memcpy(pCmd, RW_NDEF_T4T_CC_Select, sizeof(RW_NDEF_T4T_CC_Select));
       *pCmd_size = sizeof(RW_NDEF_T4T_CC_Select);
-      eRW_NDEF_T4T_State = Selecting_CC;
+      pCtx->State = Selecting_CC;
     } else {
       /* Select NDEF Application in version 1.0 */
       memcpy(pCmd, RW_NDEF_T4T_APP_Select10, sizeof(RW_NDEF_T4T_APP_Select10));
       *pCmd_size = sizeof(RW_NDEF_T4T_APP_Select10);
-      eRW_NDEF_T4T_State = Selecting_NDEF_Application10;
+      pCtx->State = Selecting_NDEF_Application10;
     }
     break;
 
@@ -103,7 +234,7 @@ void RW_NDEF_T4T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
       memcpy(pCmd, RW_NDEF_T4T_CC_Select, sizeof(RW_NDEF_T4T_CC_Select));
       pCmd[3] = 0x00;
       *pCmd_size = sizeof(RW_NDEF_T4T_CC_Select);
-      eRW_NDEF_T4T_State = Selecting_CC;
+      pCtx->State = Selecting_CC;
     }
     break;
 
@@ -113,96 +244,88 @@ void RW_NDEF_T4T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
       /* Read CC */
       memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
       *pCmd_size = sizeof(RW_NDEF_T4T_Read);
-      eRW_NDEF_T4T_State = Reading_CC;
+      pCtx->State = Reading_CC;
     }
     break;
 
   case Reading_CC:
-    /* Is CC Read ?*/
-    if ((!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK,
-                 sizeof(RW_NDEF_T4T_OK))) &&
-        (Rsp_size == 15 + 2)) {
-      /* Fill CC structure */
-      RW_NDEF_T4T_Ndef.MappingVersion = pRsp[2];
-      RW_NDEF_T4T_Ndef.MLe = (pRsp[3] << 8) + pRsp[4];
-      RW_NDEF_T4T_Ndef.MLc = (pRsp[5] << 8) + pRsp[6];
-      RW_NDEF_T4T_Ndef.FileID[0] = pRsp[9];
-      RW_NDEF_T4T_Ndef.FileID[1] = pRsp[10];
-      RW_NDEF_T4T_Ndef.MaxNdefFileSize = (pRsp[11] << 8) + pRsp[12];
-      RW_NDEF_T4T_Ndef.RdAccess = pRsp[13];
-      RW_NDEF_T4T_Ndef.WrAccess = pRsp[14];
-
-      /* Select NDEF */
-      memcpy(pCmd, RW_NDEF_T4T_NDEF_Select, sizeof(RW_NDEF_T4T_NDEF_Select));
-      if (RW_NDEF_T4T_Ndef.MappingVersion == 0x10)
-        pCmd[3] = 0x00;
-      pCmd[5] = RW_NDEF_T4T_Ndef.FileID[0];
-      pCmd[6] = RW_NDEF_T4T_Ndef.FileID[1];
-      *pCmd_size = sizeof(RW_NDEF_T4T_NDEF_Select);
-      eRW_NDEF_T4T_State = Selecting_NDEF;
-    }
+    RW_NDEF_T4T_Reading_CC(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
     break;
 
   case Selecting_NDEF:
     /* Is NDEF Selected ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
       /* Get NDEF file size */
-      memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
-      *pCmd_size = sizeof(RW_NDEF_T4T_Read);
-      pCmd[4] = 2;
-      eRW_NDEF_T4T_State = Reading_NDEF_Size;
+      RW_NDEF_T4T_ReadBinary(0, pNdef->NlenSize, pCmd, pCmd_size);
+      pCtx->State = Reading_NDEF_Size;
     }
     break;
 
   case Reading_NDEF_Size:
     /* Is Read Success ?*/
-    if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
-      RW_NDEF_T4T_Ndef.MessageSize = (pRsp[0] << 8) + pRsp[1];
+    if ((Rsp_size >= pNdef->NlenSize + 2) &&
+        !memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
+      unsigned long Size = (pRsp[0] << 8) + pRsp[1];
 
-      /* If provisioned buffer is not large enough, notify the application and
-       * stop reading */
-      if (RW_NDEF_T4T_Ndef.MessageSize > RW_MAX_NDEF_FILE_SIZE) {
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(NULL, 0);
+      if (pNdef->NlenSize == 4)
+        Size = (Size << 16) + (pRsp[2] << 8) + pRsp[3];
+
+      /* If provisioned buffer is not large enough or message is empty, notify
+       * the application and stop reading, sizes are handled on 16 bits */
+      if ((Size == 0) || (Size > 0xFFFF) || !RW_NDEF_Fits(pCtx, Size)) {
+        RW_NDEF_Notify(pCtx, NULL, 0);
         break;
       }
 
-      RW_NDEF_T4T_Ndef.MessagePtr = 0;
+      pNdef->MessageSize = Size;
+      pNdef->MessagePtr = 0;
 
       /* Read NDEF data */
-      memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
-      pCmd[3] = 2;
-      pCmd[4] = (RW_NDEF_T4T_Ndef.MessageSize > RW_NDEF_T4T_Ndef.MLe - 1)
-                    ? RW_NDEF_T4T_Ndef.MLe - 1
-                    : (unsigned char)RW_NDEF_T4T_Ndef.MessageSize;
-      *pCmd_size = sizeof(RW_NDEF_T4T_Read);
-      eRW_NDEF_T4T_State = Reading_NDEF;
+      RW_NDEF_T4T_ReadBinary(pNdef->NlenSize, RW_NDEF_T4T_ReadSize(pCtx), pCmd,
+                             pCmd_size);
+      pCtx->State = Reading_NDEF;
     }
     break;
 
   case Reading_NDEF:
     /* Is Read Success ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
-      memcpy(&RW_NDEF_T4T_Ndef.pMessage[RW_NDEF_T4T_Ndef.MessagePtr], pRsp,
-             Rsp_size - 2);
-      RW_NDEF_T4T_Ndef.MessagePtr += Rsp_size - 2;
+      unsigned char *pData = pRsp;
+      unsigned short Size = Rsp_size - 2;
+
+      /* ODO responses come wrapped in a discretionary data object */
+      if (pNdef->NlenSize + pNdef->MessagePtr > T4T_MAX_OFFSET) {
+        if ((Size < 2) || (pRsp[0] != 0x53))
+          break;
+        if (pRsp[1] == 0x81) {
+          pData = &pRsp[3];
+          Size = pRsp[2];
+        } else {
+          pData = &pRsp[2];
+          Size = pRsp[1];
+        }
+      }
+
+      if (Size > pNdef->MessageSize - pNdef->MessagePtr)
+        Size = pNdef->MessageSize - pNdef->MessagePtr;
+
+      /* Card returned no data, stop reading */
+      if (Size == 0) {
+        RW_NDEF_Notify(pCtx, NULL, 0);
+        break;
+      }
+
+      RW_NDEF_Store(pCtx, pNdef->MessagePtr, pData, Size, pNdef->MessageSize);
+      pNdef->MessagePtr += Size;
 
       /* Is NDEF message read completed ?*/
-      if (RW_NDEF_T4T_Ndef.MessagePtr == RW_NDEF_T4T_Ndef.MessageSize) {
+      if (pNdef->MessagePtr == pNdef->MessageSize) {
         /* Notify application of the NDEF reception */
-        if (pRW_NDEF_PullCb != NULL)
-          pRW_NDEF_PullCb(RW_NDEF_T4T_Ndef.pMessage,
-                          RW_NDEF_T4T_Ndef.MessageSize);
+        RW_NDEF_Notify(pCtx, pCtx->pBuffer, pNdef->MessageSize);
       } else {
         /* Read NDEF data */
-        memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
-        pCmd[3] = RW_NDEF_T4T_Ndef.MessagePtr + 2;
-        pCmd[4] = ((RW_NDEF_T4T_Ndef.MessageSize -
-                    RW_NDEF_T4T_Ndef.MessagePtr) > RW_NDEF_T4T_Ndef.MLe - 1)
-                      ? RW_NDEF_T4T_Ndef.MLe - 1
-                      : (unsigned char)(RW_NDEF_T4T_Ndef.MessageSize -
-                                        RW_NDEF_T4T_Ndef.MessagePtr);
-        *pCmd_size = sizeof(RW_NDEF_T4T_Read);
+        RW_NDEF_T4T_ReadBinary(pNdef->NlenSize + pNdef->MessagePtr,
+                               RW_NDEF_T4T_ReadSize(pCtx), pCmd, pCmd_size);
       }
     }
     break;
@@ -212,17 +335,20 @@ void RW_NDEF_T4T_Read_Next(unsigned char *pRsp, unsigned short Rsp_size,
   }
 }
 
-void RW_NDEF_T4T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
-                            unsigned char *pCmd, unsigned short *pCmd_size) {
+void RW_NDEF_T4T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size) {
+  RW_NDEF_T4T_Ndef_t *pNdef = &pCtx->Tag.T4T;
+
   /* By default no further command to be sent */
   *pCmd_size = 0;
 
-  switch (eRW_NDEF_T4T_State) {
+  switch (pCtx->State) {
   case Initial:
     /* Select NDEF Application in version 2.0 */
     memcpy(pCmd, RW_NDEF_T4T_APP_Select20, sizeof(RW_NDEF_T4T_APP_Select20));
     *pCmd_size = sizeof(RW_NDEF_T4T_APP_Select20);
-    eRW_NDEF_T4T_State = Selecting_NDEF_Application20;
+    pCtx->State = Selecting_NDEF_Application20;
     break;
 
   case Selecting_NDEF_Application20:
@@ -231,12 +357,12 @@ void RW_NDEF_T4T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
       /* Select CC */
       memcpy(pCmd, RW_NDEF_T4T_CC_Select, sizeof(RW_NDEF_T4T_CC_Select));
       *pCmd_size = sizeof(RW_NDEF_T4T_CC_Select);
-      eRW_NDEF_T4T_State = Selecting_CC;
+      pCtx->State = Selecting_CC;
     } else {
       /* Select NDEF Application in version 1.0 */
       memcpy(pCmd, RW_NDEF_T4T_APP_Select10, sizeof(RW_NDEF_T4T_APP_Select10));
       *pCmd_size = sizeof(RW_NDEF_T4T_APP_Select10);
-      eRW_NDEF_T4T_State = Selecting_NDEF_Application10;
+      pCtx->State = Selecting_NDEF_Application10;
     }
     break;
 
@@ -247,7 +373,7 @@ void RW_NDEF_T4T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
       memcpy(pCmd, RW_NDEF_T4T_CC_Select, sizeof(RW_NDEF_T4T_CC_Select));
       pCmd[3] = 0x00;
       *pCmd_size = sizeof(RW_NDEF_T4T_CC_Select);
-      eRW_NDEF_T4T_State = Selecting_CC;
+      pCtx->State = Selecting_CC;
     }
     break;
 
@@ -257,84 +383,59 @@ void RW_NDEF_T4T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
       /* Read CC */
       memcpy(pCmd, RW_NDEF_T4T_Read, sizeof(RW_NDEF_T4T_Read));
       *pCmd_size = sizeof(RW_NDEF_T4T_Read);
-      eRW_NDEF_T4T_State = Reading_CC;
+      pCtx->State = Reading_CC;
     }
     break;
 
   case Reading_CC:
-    /* Is CC Read ?*/
-    if ((!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK,
-                 sizeof(RW_NDEF_T4T_OK))) &&
-        (Rsp_size == 15 + 2)) {
-      /* Fill CC structure */
-      RW_NDEF_T4T_Ndef.MappingVersion = pRsp[2];
-      RW_NDEF_T4T_Ndef.MLe = (pRsp[3] << 8) + pRsp[4];
-      RW_NDEF_T4T_Ndef.MLc = (pRsp[5] << 8) + pRsp[6];
-      RW_NDEF_T4T_Ndef.FileID[0] = pRsp[9];
-      RW_NDEF_T4T_Ndef.FileID[1] = pRsp[10];
-      RW_NDEF_T4T_Ndef.MaxNdefFileSize = (pRsp[11] << 8) + pRsp[12];
-      RW_NDEF_T4T_Ndef.RdAccess = pRsp[13];
-      RW_NDEF_T4T_Ndef.WrAccess = pRsp[14];
-
-      /* Select NDEF */
-      memcpy(pCmd, RW_NDEF_T4T_NDEF_Select, sizeof(RW_NDEF_T4T_NDEF_Select));
-      if (RW_NDEF_T4T_Ndef.MappingVersion == 0x10)
-        pCmd[3] = 0x00;
-      pCmd[5] = RW_NDEF_T4T_Ndef.FileID[0];
-      pCmd[6] = RW_NDEF_T4T_Ndef.FileID[1];
-      *pCmd_size = sizeof(RW_NDEF_T4T_NDEF_Select);
-      eRW_NDEF_T4T_State = Selecting_NDEF;
-    }
+    RW_NDEF_T4T_Reading_CC(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    /* Read-only file or message too large, the tag is left untouched rather
+     * than emptied by the NLEN clearing */
+    if ((pCtx->State == Selecting_NDEF) &&
+        ((pNdef->WrAccess != 0x00) ||
+         (pNdef->NlenSize + (unsigned long)pCtx->MessageSize >
+          pNdef->MaxNdefFileSize)))
+      *pCmd_size = 0;
     break;
 
   case Selecting_NDEF:
     /* Is NDEF Selected ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
+      unsigned char Nlen[4] = {0, 0, 0, 0};
+
       /* Clearing NDEF message size*/
-      memcpy(pCmd, RW_NDEF_T4T_Write, sizeof(RW_NDEF_T4T_Write));
-      pCmd[4] = 2;
-      pCmd[5] = 0;
-      pCmd[6] = 0;
-      *pCmd_size = sizeof(RW_NDEF_T4T_Write) + 2;
-      RW_NDEF_T4T_Ndef.MessagePtr = 0;
-      eRW_NDEF_T4T_State = Writing_NDEF;
+      RW_NDEF_T4T_UpdateBinary(0, Nlen, pNdef->NlenSize, pCmd, pCmd_size);
+      pNdef->MessagePtr = 0;
+      pCtx->State = Writing_NDEF;
     }
     break;
 
   case Writing_NDEF:
     /* Is Write Success ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
+      unsigned char Size = RW_NDEF_T4T_WriteSize(pCtx);
+
       /* Writing NDEF message */
-      memcpy(pCmd, RW_NDEF_T4T_Write, sizeof(RW_NDEF_T4T_Write));
-      pCmd[2] = (RW_NDEF_T4T_Ndef.MessagePtr + 2) >> 8;
-      pCmd[3] = (RW_NDEF_T4T_Ndef.MessagePtr + 2) & 0xFF;
-      if ((RW_NdefMessage_size - RW_NDEF_T4T_Ndef.MessagePtr) < WRITE_SZ) {
-        pCmd[4] = (RW_NdefMessage_size - RW_NDEF_T4T_Ndef.MessagePtr);
-        memcpy(&pCmd[5], pRW_NdefMessage + RW_NDEF_T4T_Ndef.MessagePtr,
-               (RW_NdefMessage_size - RW_NDEF_T4T_Ndef.MessagePtr));
-        *pCmd_size = sizeof(RW_NDEF_T4T_Write) +
-                     (RW_NdefMessage_size - RW_NDEF_T4T_Ndef.MessagePtr);
-        eRW_NDEF_T4T_State = Writing_NDEFsize;
-      } else {
-        pCmd[4] = WRITE_SZ;
-        memcpy(&pCmd[5], pRW_NdefMessage + RW_NDEF_T4T_Ndef.MessagePtr,
-               WRITE_SZ);
-        *pCmd_size = sizeof(RW_NDEF_T4T_Write) + WRITE_SZ;
-        RW_NDEF_T4T_Ndef.MessagePtr += WRITE_SZ;
-        eRW_NDEF_T4T_State = Writing_NDEF;
-      }
+      RW_NDEF_T4T_UpdateBinary(pNdef->NlenSize + pNdef->MessagePtr,
+                               pCtx->pMessage + pNdef->MessagePtr, Size, pCmd,
+                               pCmd_size);
+      pNdef->MessagePtr += Size;
+
+      /* Last chunk written, NLEN comes next */
+      if (pNdef->MessagePtr >= pCtx->MessageSize)
+        pCtx->State = Writing_NDEFsize;
     }
     break;
 
   case Writing_NDEFsize:
     /* Is Write Success ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
-      memcpy(pCmd, RW_NDEF_T4T_Write, sizeof(RW_NDEF_T4T_Write));
-      pCmd[4] = 2;
-      pCmd[5] = RW_NdefMessage_size >> 8;
-      pCmd[6] = RW_NdefMessage_size & 0xFF;
-      *pCmd_size = sizeof(RW_NDEF_T4T_Write) + 2;
-      eRW_NDEF_T4T_State = Write_NDEFcomplete;
+      unsigned char Nlen[4] = {0, 0, (unsigned char)(pCtx->MessageSize >> 8),
+                               (unsigned char)(pCtx->MessageSize & 0xFF)};
+
+      RW_NDEF_T4T_UpdateBinary(0, &Nlen[4 - pNdef->NlenSize], pNdef->NlenSize,
+                               pCmd, pCmd_size);
+      pCtx->State = Write_NDEFcomplete;
     }
     break;
 
@@ -342,8 +443,8 @@ void RW_NDEF_T4T_Write_Next(unsigned char *pRsp, unsigned short Rsp_size,
     /* Is Write Success ?*/
     if (!memcmp(&pRsp[Rsp_size - 2], RW_NDEF_T4T_OK, sizeof(RW_NDEF_T4T_OK))) {
       /* Notify application of the NDEF reception */
-      if (pRW_NDEF_PushCb != NULL)
-        pRW_NDEF_PushCb(pRW_NdefMessage, RW_NdefMessage_size);
+      if (pCtx->pPushCb != NULL)
+        pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
     }
     break;
 
@@ -12,8 +12,10 @@
  *                          arising from its use.
  */
 
-void RW_NDEF_T4T_Reset(void);
-void RW_NDEF_T4T_Read_Next(unsigned char *pCmd, unsigned short Cmd_size,
-                           unsigned char *Rsp, unsigned short *pRsp_size);
-void RW_NDEF_T4T_Write_Next(unsigned char *pCmd, unsigned short Cmd_size,
-                            unsigned char *Rsp, unsigned short *pRsp_size);
+void RW_NDEF_T4T_Reset(RW_NDEF_Context_t *pCtx);
+void RW_NDEF_T4T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                           unsigned short Cmd_size, unsigned char *Rsp,
+                           unsigned short *pRsp_size);
+void RW_NDEF_T4T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                            unsigned short Cmd_size, unsigned char *Rsp,
+                            unsigned short *pRsp_size);
@@ -0,0 +1,503 @@
+/**
+ * NFC Forum Type 5 Tag (ISO15693) NDEF read and write
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "RW_NDEF_T5T.h"
+#include "RW_NDEF_TLV.h"
+#include "tool.h"
+
+/* Capability Container */
+#define T5T_MAGIC_NUMBER 0xE1
+#define T5T_MAGIC_NUMBER_EXT 0xE2 /* 2 bytes block numbers */
+#define T5T_CC_VERSION_MASK 0xC0
+#define T5T_CC_VERSION_1 0x40
+#define T5T_CC_READ_ACCESS 0x0C
+#define T5T_CC_WRITE_ACCESS 0x03
+#define T5T_CC_MBREAD 0x01
+#define T5T_CC_SZ 4
+#define T5T_CC_EXT_SZ 8 /* MLEN in bytes 6 and 7 when byte 2 is 0 */
+
+/* Request flags */
+#define T5T_FLAG_HIGH_RATE 0x02
+#define T5T_FLAG_SELECT 0x10
+#define T5T_FLAG_ADDRESS 0x20
+/* Response flags */
+#define T5T_FLAG_ERROR 0x01
+
+#define T5T_READ_SINGLE 0x20
+#define T5T_WRITE_SINGLE 0x21
+#define T5T_READ_MULTIPLE 0x23
+#define T5T_WRITE_MULTIPLE 0x24
+#define T5T_SELECT 0x25
+#define T5T_EXT_READ_SINGLE 0x30
+#define T5T_EXT_WRITE_SINGLE 0x31
+#define T5T_EXT_READ_MULTIPLE 0x33
+#define T5T_EXT_WRITE_MULTIPLE 0x34
+
+/* Bytes read ahead while the TLV headers are parsed */
+#define T5T_HEADER_READ_SZ 16
+
+/* RW_NDEF_T5T_CC results */
+#define T5T_CC_MORE 0
+#define T5T_CC_VALID 1
+#define T5T_CC_INVALID 2
+
+typedef enum {
+  Initial,
+  Selecting,
+  Reading_CC,
+  Reading_NDEF,
+  Clearing_Length,
+  Writing_Data,
+  Writing_Length
+} RW_NDEF_T5T_state_t;
+
+void RW_NDEF_T5T_Reset(RW_NDEF_Context_t *pCtx) {
+  pCtx->State = Initial;
+  pCtx->Tag.T5T.Mode = RW_NDEF_T5T_NON_ADDRESSED;
+  pCtx->Tag.T5T.WriteMultiple = true;
+}
+
+void RW_NDEF_T5T_SetAddressing(RW_NDEF_Context_t *pCtx, unsigned char Mode,
+                               const unsigned char *pUID) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if (pUID == NULL) {
+    pNdef->Mode = RW_NDEF_T5T_NON_ADDRESSED;
+    return;
+  }
+
+  /* The UID is sent LSB first */
+  pNdef->Mode = Mode;
+  for (unsigned char i = 0; i < sizeof(pNdef->UID); i++)
+    pNdef->UID[i] = pUID[sizeof(pNdef->UID) - 1 - i];
+}
+
+/* Request flags, command code and the UID when addressed, returns the offset
+ * of the command parameters */
+static unsigned char RW_NDEF_T5T_Command(RW_NDEF_T5T_Ndef_t *pNdef,
+                                         unsigned char Code,
+                                         unsigned char *pCmd) {
+  pCmd[0] = T5T_FLAG_HIGH_RATE;
+  pCmd[1] = Code;
+
+  if (pNdef->Mode == RW_NDEF_T5T_ADDRESSED) {
+    pCmd[0] |= T5T_FLAG_ADDRESS;
+    memcpy(&pCmd[2], pNdef->UID, sizeof(pNdef->UID));
+    return 2 + sizeof(pNdef->UID);
+  }
+  if (pNdef->Mode == RW_NDEF_T5T_SELECTED)
+    pCmd[0] |= T5T_FLAG_SELECT;
+  return 2;
+}
+
+/* Block number or number of blocks, on 2 bytes with the extended commands */
+static unsigned char RW_NDEF_T5T_Param(RW_NDEF_T5T_Ndef_t *pNdef,
+                                       unsigned short Value,
+                                       unsigned char *pCmd) {
+  pCmd[0] = Value & 0xFF;
+  if (!pNdef->Extended)
+    return 1;
+  pCmd[1] = Value >> 8;
+  return 2;
+}
+
+static bool RW_NDEF_T5T_Success(unsigned char *pRsp, unsigned short Rsp_size) {
+  return (Rsp_size >= 2) && ((pRsp[0] & T5T_FLAG_ERROR) == 0) &&
+         (pRsp[Rsp_size - 1] == 0x00);
+}
+
+/* Read from BlkNb on the blocks holding Needed bytes, counted from the start
+ * of BlkNb, in one READ_MULTIPLE_BLOCKS when the tag supports it */
+static void RW_NDEF_T5T_ReadBlocks(RW_NDEF_Context_t *pCtx,
+                                   unsigned short Needed, unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned short Blocks = 1;
+  unsigned char Size;
+
+  if (pNdef->ReadMultiple) {
+    unsigned short MaxPayload =
+        (pCtx->MaxPayload != 0) ? pCtx->MaxPayload : 0xFF;
+    unsigned short Last = (pNdef->Tlv.End - 1) / pNdef->BlockSize;
+
+    if (Needed == 0)
+      Needed = T5T_HEADER_READ_SZ;
+    Blocks = (Needed + pNdef->BlockSize - 1) / pNdef->BlockSize;
+    /* Response flags, blocks and status in one data packet */
+    if (Blocks > (MaxPayload - 2) / pNdef->BlockSize)
+      Blocks = (MaxPayload - 2) / pNdef->BlockSize;
+    if (Blocks > Last + 1 - pNdef->BlkNb)
+      Blocks = Last + 1 - pNdef->BlkNb;
+    if (Blocks == 0)
+      Blocks = 1;
+  }
+
+  if (Blocks > 1) {
+    Size = RW_NDEF_T5T_Command(
+        pNdef, pNdef->Extended ? T5T_EXT_READ_MULTIPLE : T5T_READ_MULTIPLE,
+        pCmd);
+    Size += RW_NDEF_T5T_Param(pNdef, pNdef->BlkNb, &pCmd[Size]);
+    Size += RW_NDEF_T5T_Param(pNdef, Blocks - 1, &pCmd[Size]);
+  } else {
+    Size = RW_NDEF_T5T_Command(
+        pNdef, pNdef->Extended ? T5T_EXT_READ_SINGLE : T5T_READ_SINGLE, pCmd);
+    Size += RW_NDEF_T5T_Param(pNdef, pNdef->BlkNb, &pCmd[Size]);
+  }
+  pNdef->Blocks = Blocks;
+  *pCmd_size = Size;
+}
+
+/* Select the tag in selected mode, then read block 0 */
+static void RW_NDEF_T5T_Start(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                              unsigned short Rsp_size, unsigned char *pCmd,
+                              unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if ((pCtx->State == Initial) && (pNdef->Mode == RW_NDEF_T5T_SELECTED)) {
+    pCmd[0] = T5T_FLAG_HIGH_RATE | T5T_FLAG_ADDRESS;
+    pCmd[1] = T5T_SELECT;
+    memcpy(&pCmd[2], pNdef->UID, sizeof(pNdef->UID));
+    *pCmd_size = 2 + sizeof(pNdef->UID);
+    pCtx->State = Selecting;
+    return;
+  }
+  if ((pCtx->State == Selecting) && !RW_NDEF_T5T_Success(pRsp, Rsp_size))
+    return;
+
+  /* Block size and addressing are known once the CC is read */
+  pNdef->Extended = false;
+  pNdef->ReadMultiple = false;
+  pNdef->BlkNb = 0;
+  RW_NDEF_T5T_ReadBlocks(pCtx, 0, pCmd, pCmd_size);
+  pCtx->State = Reading_CC;
+}
+
+/* Gather the CC from the Size bytes of block BlkNb. The block size is the size
+ * of the first block read */
+static unsigned char RW_NDEF_T5T_CC(RW_NDEF_Context_t *pCtx,
+                                    unsigned char *pData, unsigned short Size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned long End;
+
+  if (pNdef->BlkNb == 0) {
+    if ((Size == 0) || (Size > RW_NDEF_T5T_MAX_BLOCK_SZ))
+      return T5T_CC_INVALID;
+    pNdef->BlockSize = Size;
+    pNdef->CCRead = 0;
+  } else if (Size != pNdef->BlockSize)
+    return T5T_CC_INVALID;
+
+  for (unsigned short i = 0; (i < Size) && (pNdef->CCRead < T5T_CC_EXT_SZ);
+       i++)
+    pNdef->CC[pNdef->CCRead++] = pData[i];
+
+  if (pNdef->CCRead < T5T_CC_SZ)
+    return T5T_CC_MORE;
+  /* Is CC valid and NDEF readable ? */
+  if (((pNdef->CC[0] != T5T_MAGIC_NUMBER) &&
+       (pNdef->CC[0] != T5T_MAGIC_NUMBER_EXT)) ||
+      ((pNdef->CC[1] & T5T_CC_VERSION_MASK) != T5T_CC_VERSION_1) ||
+      ((pNdef->CC[1] & T5T_CC_READ_ACCESS) != 0))
+    return T5T_CC_INVALID;
+
+  pNdef->CCSize = (pNdef->CC[2] != 0) ? T5T_CC_SZ : T5T_CC_EXT_SZ;
+  if (pNdef->CCRead < pNdef->CCSize)
+    return T5T_CC_MORE;
+
+  /* MLEN is the size of the data area in 8 bytes units */
+  if (pNdef->CCSize == T5T_CC_SZ)
+    End = T5T_CC_SZ + (unsigned long)pNdef->CC[2] * 8;
+  else
+    End = T5T_CC_EXT_SZ +
+          (((unsigned long)pNdef->CC[6] << 8) | pNdef->CC[7]) * 8;
+  if (End > 0xFFFF)
+    End = 0xFFFF;
+
+  pNdef->Extended = (pNdef->CC[0] == T5T_MAGIC_NUMBER_EXT);
+  pNdef->ReadMultiple = (pNdef->CC[3] & T5T_CC_MBREAD) != 0;
+  RW_NDEF_TLV_Init(&pNdef->Tlv, pNdef->CCSize, End, false);
+  return T5T_CC_VALID;
+}
+
+/* Feed the blocks read to the TLV parser */
+static unsigned char RW_NDEF_T5T_Parse(RW_NDEF_Context_t *pCtx,
+                                       unsigned char *pRsp,
+                                       unsigned short Rsp_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if (!RW_NDEF_T5T_Success(pRsp, Rsp_size) ||
+      (Rsp_size - 2 != pNdef->Blocks * pNdef->BlockSize))
+    return RW_NDEF_TLV_FAILED;
+  return RW_NDEF_TLV_Parse(pCtx, &pNdef->Tlv,
+                           pNdef->BlkNb * pNdef->BlockSize, &pRsp[1],
+                           Rsp_size - 2);
+}
+
+static void RW_NDEF_T5T_ReadMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                 unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned short Next = RW_NDEF_TLV_Next(&pNdef->Tlv);
+  unsigned short Needed = RW_NDEF_TLV_Needed(&pNdef->Tlv);
+
+  pNdef->BlkNb = Next / pNdef->BlockSize;
+  if (Needed != 0)
+    Needed += Next % pNdef->BlockSize;
+  RW_NDEF_T5T_ReadBlocks(pCtx, Needed, pCmd, pCmd_size);
+  pCtx->State = Reading_NDEF;
+}
+
+/* Handle the block(s) just read while in Reading_CC or Reading_NDEF state,
+ * returns the TLV parser status. With Locate set, the TLVs are parsed for the
+ * place of the NDEF TLV to write */
+static unsigned char RW_NDEF_T5T_Read(RW_NDEF_Context_t *pCtx,
+                                      unsigned char *pRsp,
+                                      unsigned short Rsp_size,
+                                      unsigned char *pCmd,
+                                      unsigned short *pCmd_size, bool Locate) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if (pCtx->State == Reading_CC) {
+    if (!RW_NDEF_T5T_Success(pRsp, Rsp_size))
+      return RW_NDEF_TLV_FAILED;
+
+    switch (RW_NDEF_T5T_CC(pCtx, &pRsp[1], Rsp_size - 2)) {
+    case T5T_CC_MORE:
+      pNdef->BlkNb++;
+      RW_NDEF_T5T_ReadBlocks(pCtx, 0, pCmd, pCmd_size);
+      return RW_NDEF_TLV_MORE;
+    case T5T_CC_VALID:
+      if (Locate)
+        RW_NDEF_TLV_Locate(&pNdef->Tlv);
+      break;
+    default:
+      /* No NDEF message on the tag */
+      if (!Locate)
+        RW_NDEF_Notify(pCtx, NULL, 0);
+      return RW_NDEF_TLV_FAILED;
+    }
+  }
+
+  return RW_NDEF_T5T_Parse(pCtx, pRsp, Rsp_size);
+}
+
+void RW_NDEF_T5T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size) {
+  /* By default no further command to be sent */
+  *pCmd_size = 0;
+
+  switch (pCtx->State) {
+  case Initial:
+  case Selecting:
+    RW_NDEF_T5T_Start(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    break;
+
+  case Reading_CC:
+  case Reading_NDEF:
+    if ((RW_NDEF_T5T_Read(pCtx, pRsp, Rsp_size, pCmd, pCmd_size, false) ==
+         RW_NDEF_TLV_MORE) &&
+        (*pCmd_size == 0))
+      RW_NDEF_T5T_ReadMore(pCtx, pCmd, pCmd_size);
+    break;
+
+  default:
+    break;
+  }
+}
+
+/* Byte to write at Address: the image, the bytes of the first block ahead of
+ * it as read, and a zero NDEF length while clearing */
+static unsigned char RW_NDEF_T5T_Byte(RW_NDEF_Context_t *pCtx,
+                                      unsigned short Address) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if (Address < pNdef->Address)
+    return pNdef->Head[Address % pNdef->BlockSize];
+  if ((pCtx->State == Clearing_Length) && (Address == pNdef->Address + 1))
+    return 0x00;
+  return RW_NDEF_TLV_ImageByte(pCtx, Address - pNdef->Address,
+                               pNdef->ImageSize);
+}
+
+/* Write up to Blocks blocks from BlkNb on, in one WRITE_MULTIPLE_BLOCKS unless
+ * the tag refused it */
+static void RW_NDEF_T5T_WriteBlocks(RW_NDEF_Context_t *pCtx,
+                                    unsigned short Blocks,
+                                    unsigned char *pCmd,
+                                    unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned short Size;
+
+  if (!pNdef->WriteMultiple)
+    Blocks = 1;
+  if (Blocks > 1) {
+    unsigned short MaxPayload =
+        (pCtx->MaxPayload != 0) ? pCtx->MaxPayload : 0xFF;
+    unsigned short Header =
+        ((pNdef->Mode == RW_NDEF_T5T_ADDRESSED) ? 2 + sizeof(pNdef->UID) : 2) +
+        (pNdef->Extended ? 4 : 2);
+
+    if (Blocks > (MaxPayload - Header) / pNdef->BlockSize)
+      Blocks = (MaxPayload - Header) / pNdef->BlockSize;
+    if (Blocks == 0)
+      Blocks = 1;
+  }
+
+  if (Blocks > 1) {
+    Size = RW_NDEF_T5T_Command(
+        pNdef, pNdef->Extended ? T5T_EXT_WRITE_MULTIPLE : T5T_WRITE_MULTIPLE,
+        pCmd);
+    Size += RW_NDEF_T5T_Param(pNdef, pNdef->BlkNb, &pCmd[Size]);
+    Size += RW_NDEF_T5T_Param(pNdef, Blocks - 1, &pCmd[Size]);
+  } else {
+    Size = RW_NDEF_T5T_Command(
+        pNdef, pNdef->Extended ? T5T_EXT_WRITE_SINGLE : T5T_WRITE_SINGLE,
+        pCmd);
+    Size += RW_NDEF_T5T_Param(pNdef, pNdef->BlkNb, &pCmd[Size]);
+  }
+
+  for (unsigned short i = 0; i < Blocks * pNdef->BlockSize; i++)
+    pCmd[Size++] =
+        RW_NDEF_T5T_Byte(pCtx, pNdef->BlkNb * pNdef->BlockSize + i);
+  pNdef->Blocks = Blocks;
+  *pCmd_size = Size;
+}
+
+/* Write the data blocks from BlkNb on, the block holding the NDEF length is
+ * written last */
+static void RW_NDEF_T5T_WriteMore(RW_NDEF_Context_t *pCtx, unsigned char *pCmd,
+                                  unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned short Last =
+      (pNdef->Address + pNdef->ImageSize - 1) / pNdef->BlockSize;
+
+  if (pNdef->BlkNb == pNdef->LengthBlk)
+    pNdef->BlkNb++;
+
+  if (pNdef->BlkNb <= Last) {
+    RW_NDEF_T5T_WriteBlocks(pCtx,
+                            ((pNdef->BlkNb < pNdef->LengthBlk)
+                                 ? pNdef->LengthBlk
+                                 : Last + 1) -
+                                pNdef->BlkNb,
+                            pCmd, pCmd_size);
+    pCtx->State = Writing_Data;
+  } else {
+    pNdef->BlkNb = pNdef->LengthBlk;
+    pCtx->State = Writing_Length;
+    RW_NDEF_T5T_WriteBlocks(pCtx, 1, pCmd, pCmd_size);
+  }
+}
+
+/* Write the message TLVs at the place found by the TLV parser, pData holds the
+ * blocks just read. The NDEF length is cleared first and written last, so
+ * that the tag shows no message while it is being written */
+static void RW_NDEF_T5T_StartWrite(RW_NDEF_Context_t *pCtx,
+                                   unsigned char *pData, unsigned char *pCmd,
+                                   unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned short Address = RW_NDEF_TLV_Next(&pNdef->Tlv);
+  unsigned short Space = RW_NDEF_TLV_Space(&pNdef->Tlv, Address);
+
+  /* Is tag writable ? */
+  if ((pNdef->CC[1] & T5T_CC_WRITE_ACCESS) != 0)
+    return;
+
+  /* Is size enough ? */
+  pNdef->ImageSize = RW_NDEF_TLV_ImageSize(pCtx);
+  if (pNdef->ImageSize > Space)
+    return;
+  /* Terminate the TLVs if there is room left */
+  if (pNdef->ImageSize < Space)
+    pNdef->ImageSize++;
+
+  memcpy(pNdef->Head,
+         &pData[(Address / pNdef->BlockSize - pNdef->BlkNb) *
+                pNdef->BlockSize],
+         pNdef->BlockSize);
+  pNdef->Address = Address;
+  pNdef->LengthBlk = (Address + 1) / pNdef->BlockSize;
+
+  pNdef->BlkNb = pNdef->LengthBlk;
+  pCtx->State = Clearing_Length;
+  RW_NDEF_T5T_WriteBlocks(pCtx, 1, pCmd, pCmd_size);
+}
+
+/* Is write success ? A refused WRITE_MULTIPLE_BLOCKS is sent again block by
+ * block */
+static bool RW_NDEF_T5T_Written(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                                unsigned short Rsp_size, unsigned char *pCmd,
+                                unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+
+  if (RW_NDEF_T5T_Success(pRsp, Rsp_size))
+    return true;
+
+  if ((pNdef->Blocks > 1) && pNdef->WriteMultiple) {
+    pNdef->WriteMultiple = false;
+    RW_NDEF_T5T_WriteBlocks(pCtx, 1, pCmd, pCmd_size);
+  }
+  return false;
+}
+
+void RW_NDEF_T5T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size) {
+  RW_NDEF_T5T_Ndef_t *pNdef = &pCtx->Tag.T5T;
+  unsigned char Status;
+
+  /* By default no further command to be sent */
+  *pCmd_size = 0;
+
+  switch (pCtx->State) {
+  case Initial:
+  case Selecting:
+    RW_NDEF_T5T_Start(pCtx, pRsp, Rsp_size, pCmd, pCmd_size);
+    break;
+
+  case Reading_CC:
+  case Reading_NDEF:
+    /* Look for the place of the NDEF TLV */
+    Status = RW_NDEF_T5T_Read(pCtx, pRsp, Rsp_size, pCmd, pCmd_size, true);
+    if (*pCmd_size != 0)
+      break;
+    if (Status == RW_NDEF_TLV_MORE)
+      RW_NDEF_T5T_ReadMore(pCtx, pCmd, pCmd_size);
+    else if (Status == RW_NDEF_TLV_DONE)
+      RW_NDEF_T5T_StartWrite(pCtx, &pRsp[1], pCmd, pCmd_size);
+    break;
+
+  case Clearing_Length:
+    if (RW_NDEF_T5T_Written(pCtx, pRsp, Rsp_size, pCmd, pCmd_size)) {
+      pNdef->BlkNb = pNdef->Address / pNdef->BlockSize;
+      RW_NDEF_T5T_WriteMore(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Writing_Data:
+    if (RW_NDEF_T5T_Written(pCtx, pRsp, Rsp_size, pCmd, pCmd_size)) {
+      pNdef->BlkNb += pNdef->Blocks;
+      RW_NDEF_T5T_WriteMore(pCtx, pCmd, pCmd_size);
+    }
+    break;
+
+  case Writing_Length:
+    if (RW_NDEF_T5T_Written(pCtx, pRsp, Rsp_size, pCmd, pCmd_size)) {
+      /* Notify application of the NDEF send completion */
+      if (pCtx->pPushCb != NULL)
+        pCtx->pPushCb(pCtx->pMessage, pCtx->MessageSize);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
@@ -0,0 +1,33 @@
+/**
+ * NFC Forum Type 5 Tag (ISO15693) NDEF read and write
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef RW_NDEF_T5T_H
+#define RW_NDEF_T5T_H
+
+#include "RW_NDEF.h"
+
+/* Request addressing */
+#define RW_NDEF_T5T_NON_ADDRESSED 0 /* Any tag in the field answers */
+#define RW_NDEF_T5T_ADDRESSED 1     /* Requests carry the UID */
+#define RW_NDEF_T5T_SELECTED 2      /* Tag selected once, then select flag */
+
+void RW_NDEF_T5T_Reset(RW_NDEF_Context_t *pCtx);
+/* pUID is the 8 bytes UID, MSB first as reported at discovery */
+void RW_NDEF_T5T_SetAddressing(RW_NDEF_Context_t *pCtx, unsigned char Mode,
+                               const unsigned char *pUID);
+void RW_NDEF_T5T_Read_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                           unsigned short Rsp_size, unsigned char *pCmd,
+                           unsigned short *pCmd_size);
+void RW_NDEF_T5T_Write_Next(RW_NDEF_Context_t *pCtx, unsigned char *pRsp,
+                            unsigned short Rsp_size, unsigned char *pCmd,
+                            unsigned short *pCmd_size);
+
+#endif
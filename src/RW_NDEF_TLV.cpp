@@ -0,0 +1,285 @@
+/**
+ * Incremental TLV parser for the NDEF data area of T1T, T2T, T5T and MIFARE
+ * Classic
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "RW_NDEF_TLV.h"
+
+#define TLV_NULL 0x00
+#define TLV_LOCK_CONTROL 0x01
+#define TLV_MEMORY_CONTROL 0x02
+#define TLV_NDEF 0x03
+#define TLV_TERMINATOR 0xFE
+
+typedef enum {
+  Reading_Type,
+  Reading_Length,
+  Reading_Length_Hi,
+  Reading_Length_Lo,
+  Reading_Control,
+  Reading_Message
+} RW_NDEF_TLV_state_t;
+
+void RW_NDEF_TLV_Init(RW_NDEF_TLV_t *pTlv, unsigned short Start,
+                      unsigned short End, bool Controls) {
+  pTlv->Next = Start;
+  pTlv->End = End;
+  pTlv->Controls = Controls;
+  pTlv->Locate = false;
+  pTlv->Null = 0;
+  pTlv->State = Reading_Type;
+  pTlv->Areas = 0;
+}
+
+void RW_NDEF_TLV_Locate(RW_NDEF_TLV_t *pTlv) { pTlv->Locate = true; }
+
+void RW_NDEF_TLV_Reserve(RW_NDEF_TLV_t *pTlv, unsigned long Start,
+                         unsigned short Size) {
+  if ((pTlv->Areas == RW_NDEF_TLV_MAX_AREAS) || (Start >= pTlv->End))
+    return;
+  if (Size > pTlv->End - Start)
+    Size = pTlv->End - Start;
+
+  pTlv->AreaStart[pTlv->Areas] = Start;
+  pTlv->AreaSize[pTlv->Areas] = Size;
+  pTlv->Areas++;
+}
+
+/* First address from Address on which is not in a reserved area */
+static unsigned short RW_NDEF_TLV_Skip(const RW_NDEF_TLV_t *pTlv,
+                                       unsigned short Address) {
+  unsigned char i = 0;
+
+  while (i < pTlv->Areas) {
+    if ((Address >= pTlv->AreaStart[i]) &&
+        (Address - pTlv->AreaStart[i] < pTlv->AreaSize[i])) {
+      Address = pTlv->AreaStart[i] + pTlv->AreaSize[i];
+      i = 0;
+    } else
+      i++;
+  }
+  return Address;
+}
+
+/* Number of data bytes from Address on before a reserved area or the end */
+static unsigned short RW_NDEF_TLV_Run(const RW_NDEF_TLV_t *pTlv,
+                                      unsigned short Address) {
+  unsigned short Run = pTlv->End - Address;
+
+  for (unsigned char i = 0; i < pTlv->Areas; i++) {
+    if ((pTlv->AreaStart[i] >= Address) &&
+        (pTlv->AreaStart[i] - Address < Run))
+      Run = pTlv->AreaStart[i] - Address;
+  }
+  return Run;
+}
+
+/* Move Next over Count data bytes */
+static void RW_NDEF_TLV_Advance(RW_NDEF_TLV_t *pTlv, unsigned short Count) {
+  pTlv->Next = RW_NDEF_TLV_Skip(pTlv, pTlv->Next);
+  while ((Count > 0) && (pTlv->Next < pTlv->End)) {
+    unsigned short Step = RW_NDEF_TLV_Run(pTlv, pTlv->Next);
+
+    if (Step > Count)
+      Step = Count;
+    pTlv->Next = RW_NDEF_TLV_Skip(pTlv, pTlv->Next + Step);
+    Count -= Step;
+  }
+}
+
+/* Remember the area described by the Lock or Memory Control TLV just read */
+static void RW_NDEF_TLV_AddArea(RW_NDEF_TLV_t *pTlv) {
+  unsigned long Start = ((unsigned long)(pTlv->Value[0] >> 4)
+                         << (pTlv->Value[2] & 0x0F)) +
+                        (pTlv->Value[0] & 0x0F);
+  unsigned short Size = (pTlv->Value[1] != 0) ? pTlv->Value[1] : 256;
+
+  /* Lock Control TLV gives the number of lock bits */
+  if (pTlv->Type == TLV_LOCK_CONTROL)
+    Size = (Size + 7) / 8;
+
+  if (pTlv->Controls)
+    RW_NDEF_TLV_Reserve(pTlv, Start, Size);
+}
+
+/* TLV length known, returns false if the value cannot be read */
+static bool RW_NDEF_TLV_Value(RW_NDEF_Context_t *pCtx, RW_NDEF_TLV_t *pTlv) {
+  if (pTlv->Type == TLV_NDEF) {
+    /* Is message empty or larger than the provisioned buffer ? */
+    if ((pTlv->Length == 0) || !RW_NDEF_Fits(pCtx, pTlv->Length))
+      return false;
+    pTlv->MessageSize = pTlv->Length;
+    pTlv->MessagePtr = 0;
+    pTlv->State = Reading_Message;
+  } else if (((pTlv->Type == TLV_LOCK_CONTROL) ||
+              (pTlv->Type == TLV_MEMORY_CONTROL)) &&
+             (pTlv->Length == 3)) {
+    pTlv->State = Reading_Control;
+  } else {
+    /* Proprietary or unknown TLV, its value is not read at all */
+    RW_NDEF_TLV_Advance(pTlv, pTlv->Length);
+    pTlv->State = Reading_Type;
+  }
+  return true;
+}
+
+unsigned char RW_NDEF_TLV_Parse(RW_NDEF_Context_t *pCtx, RW_NDEF_TLV_t *pTlv,
+                                unsigned short Address, unsigned char *pData,
+                                unsigned short Size) {
+  bool Failed = false;
+
+  pTlv->Next = RW_NDEF_TLV_Skip(pTlv, pTlv->Next);
+  while (!Failed && (pTlv->Next < pTlv->End)) {
+    unsigned short Here = pTlv->Next;
+    unsigned short i;
+
+    /* Is next byte in the data provided ? */
+    if ((pTlv->Next < Address) || (pTlv->Next - Address >= Size))
+      return RW_NDEF_TLV_MORE;
+    i = pTlv->Next - Address;
+
+    if (pTlv->State == Reading_Message) {
+      unsigned short Chunk = RW_NDEF_TLV_Run(pTlv, pTlv->Next);
+
+      if (Chunk > Size - i)
+        Chunk = Size - i;
+      if (Chunk > pTlv->MessageSize - pTlv->MessagePtr)
+        Chunk = pTlv->MessageSize - pTlv->MessagePtr;
+      RW_NDEF_Store(pCtx, pTlv->MessagePtr, &pData[i], Chunk,
+                    pTlv->MessageSize);
+      pTlv->MessagePtr += Chunk;
+      RW_NDEF_TLV_Advance(pTlv, Chunk);
+
+      /* Is NDEF read completed ? */
+      if (pTlv->MessagePtr == pTlv->MessageSize) {
+        RW_NDEF_Notify(pCtx, pCtx->pBuffer, pTlv->MessageSize);
+        return RW_NDEF_TLV_DONE;
+      }
+      continue;
+    }
+
+    RW_NDEF_TLV_Advance(pTlv, 1);
+    switch (pTlv->State) {
+    case Reading_Type:
+      /* Is it where the NDEF TLV is to be written ? */
+      if (pTlv->Locate && (pData[i] != TLV_NULL) &&
+          (pData[i] != TLV_LOCK_CONTROL) && (pData[i] != TLV_MEMORY_CONTROL)) {
+        pTlv->Next = Here;
+        return RW_NDEF_TLV_DONE;
+      }
+      if (pTlv->Locate && (pData[i] == TLV_NULL) && (pTlv->Null == 0))
+        pTlv->Null = Here;
+      else if (pData[i] != TLV_NULL)
+        pTlv->Null = 0;
+
+      if (pData[i] == TLV_TERMINATOR)
+        Failed = true;
+      else if (pData[i] != TLV_NULL) {
+        pTlv->Type = pData[i];
+        pTlv->State = Reading_Length;
+      }
+      break;
+
+    case Reading_Length:
+      if (pData[i] == 0xFF)
+        pTlv->State = Reading_Length_Hi;
+      else {
+        pTlv->Length = pData[i];
+        Failed = !RW_NDEF_TLV_Value(pCtx, pTlv);
+      }
+      break;
+
+    case Reading_Length_Hi:
+      pTlv->Length = pData[i] << 8;
+      pTlv->State = Reading_Length_Lo;
+      break;
+
+    case Reading_Length_Lo:
+      pTlv->Length |= pData[i];
+      Failed = !RW_NDEF_TLV_Value(pCtx, pTlv);
+      break;
+
+    case Reading_Control:
+      pTlv->Value[3 - pTlv->Length] = pData[i];
+      if (--pTlv->Length == 0) {
+        RW_NDEF_TLV_AddArea(pTlv);
+        pTlv->State = Reading_Type;
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  /* Terminator, end of data area or unusable NDEF TLV */
+  if (!pTlv->Locate)
+    RW_NDEF_Notify(pCtx, NULL, 0);
+  else if (pTlv->Null != 0)
+    pTlv->Next = pTlv->Null;
+  return RW_NDEF_TLV_FAILED;
+}
+
+unsigned short RW_NDEF_TLV_Next(const RW_NDEF_TLV_t *pTlv) {
+  return RW_NDEF_TLV_Skip(pTlv, pTlv->Next);
+}
+
+unsigned short RW_NDEF_TLV_Needed(const RW_NDEF_TLV_t *pTlv) {
+  if (pTlv->State != Reading_Message)
+    return 0;
+  return pTlv->MessageSize - pTlv->MessagePtr;
+}
+
+bool RW_NDEF_TLV_Reserved(const RW_NDEF_TLV_t *pTlv, unsigned short Address) {
+  return RW_NDEF_TLV_Skip(pTlv, Address) != Address;
+}
+
+unsigned short RW_NDEF_TLV_Space(const RW_NDEF_TLV_t *pTlv,
+                                 unsigned short Address) {
+  unsigned short Space = 0;
+
+  Address = RW_NDEF_TLV_Skip(pTlv, Address);
+  while (Address < pTlv->End) {
+    unsigned short Run = RW_NDEF_TLV_Run(pTlv, Address);
+
+    Space += Run;
+    Address = RW_NDEF_TLV_Skip(pTlv, Address + Run);
+  }
+  return Space;
+}
+
+unsigned char RW_NDEF_TLV_LengthSize(RW_NDEF_Context_t *pCtx) {
+  return (pCtx->MessageSize >= 0xFF) ? 3 : 1;
+}
+
+unsigned short RW_NDEF_TLV_ImageSize(RW_NDEF_Context_t *pCtx) {
+  return 1 + RW_NDEF_TLV_LengthSize(pCtx) + pCtx->MessageSize;
+}
+
+unsigned char RW_NDEF_TLV_ImageByte(RW_NDEF_Context_t *pCtx,
+                                    unsigned short Offset,
+                                    unsigned short ImageSize) {
+  unsigned short Header = 1 + RW_NDEF_TLV_LengthSize(pCtx);
+
+  if (Offset == 0)
+    return TLV_NDEF;
+  if (Offset < Header) {
+    if (Header == 2)
+      return pCtx->MessageSize;
+    if (Offset == 1)
+      return 0xFF;
+    return (Offset == 2) ? (pCtx->MessageSize >> 8) : pCtx->MessageSize;
+  }
+  if (Offset - Header < pCtx->MessageSize)
+    return pCtx->pMessage[Offset - Header];
+  if (Offset < ImageSize)
+    return TLV_TERMINATOR;
+  return 0x00;
+}
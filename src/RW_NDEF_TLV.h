@@ -0,0 +1,62 @@
+/**
+ * Incremental TLV parser for the NDEF data area of T1T, T2T, T5T and MIFARE
+ * Classic
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef RW_NDEF_TLV_H
+#define RW_NDEF_TLV_H
+
+#include "RW_NDEF.h"
+
+/* RW_NDEF_TLV_Parse results */
+#define RW_NDEF_TLV_MORE 0   /* Needs the data at RW_NDEF_TLV_Next() */
+#define RW_NDEF_TLV_DONE 1   /* NDEF message read and notified */
+#define RW_NDEF_TLV_FAILED 2 /* No usable NDEF message, NULL notified */
+
+/* Parse the TLVs of the data area from Start up to End (excluded). Lock and
+ * Memory Control TLVs are honored when Controls is set */
+void RW_NDEF_TLV_Init(RW_NDEF_TLV_t *pTlv, unsigned short Start,
+                      unsigned short End, bool Controls);
+/* Mark an area which is neither TLV nor message data */
+void RW_NDEF_TLV_Reserve(RW_NDEF_TLV_t *pTlv, unsigned long Start,
+                         unsigned short Size);
+/* Look for the place of the NDEF TLV to write instead of reading it: Parse
+ * returns RW_NDEF_TLV_DONE at the first TLV which is not a control TLV, with
+ * RW_NDEF_TLV_Next() on its type byte, and does not notify. When only NULL
+ * TLVs follow the control TLVs, RW_NDEF_TLV_FAILED is returned with
+ * RW_NDEF_TLV_Next() on the first of them */
+void RW_NDEF_TLV_Locate(RW_NDEF_TLV_t *pTlv);
+/* Feed Size bytes read at Address. Bytes already parsed, reserved or out of
+ * the data area are ignored, so whole blocks can be passed */
+unsigned char RW_NDEF_TLV_Parse(RW_NDEF_Context_t *pCtx, RW_NDEF_TLV_t *pTlv,
+                                unsigned short Address, unsigned char *pData,
+                                unsigned short Size);
+/* Address of the next byte needed, skipped TLVs and reserved areas are not
+ * read at all */
+unsigned short RW_NDEF_TLV_Next(const RW_NDEF_TLV_t *pTlv);
+/* Bytes known to be needed from RW_NDEF_TLV_Next() on, 0 while parsing the
+ * TLV headers */
+unsigned short RW_NDEF_TLV_Needed(const RW_NDEF_TLV_t *pTlv);
+/* Is Address in a reserved area ? */
+bool RW_NDEF_TLV_Reserved(const RW_NDEF_TLV_t *pTlv, unsigned short Address);
+/* Data bytes from Address up to the end of the data area */
+unsigned short RW_NDEF_TLV_Space(const RW_NDEF_TLV_t *pTlv,
+                                 unsigned short Address);
+
+/* TLV image of the message to write (pCtx->pMessage): NDEF TLV, then a
+ * Terminator TLV when ImageSize leaves room for it, then zero padding */
+unsigned short RW_NDEF_TLV_ImageSize(RW_NDEF_Context_t *pCtx);
+/* Size of the length field in the image, 1 or 3 */
+unsigned char RW_NDEF_TLV_LengthSize(RW_NDEF_Context_t *pCtx);
+unsigned char RW_NDEF_TLV_ImageByte(RW_NDEF_Context_t *pCtx,
+                                    unsigned short Offset,
+                                    unsigned short ImageSize);
+
+#endif
@@ -28,6 +28,19 @@ bool RemoteDevice::hasMoreTags() const {
   return this->remoteDeviceStruct.moreTagsAvailable;
 }
 
+unsigned char RemoteDevice::getDiscoveryId() const {
+  return this->remoteDeviceStruct.discoveryId;
+}
+
+// Largest data packet payload accepted by the controller for this target
+unsigned char RemoteDevice::getMaxPayloadSize() const {
+  return this->remoteDeviceStruct.maxPayloadSize;
+}
+
+const RfIntfCC_t &RemoteDevice::getRfIntf() const {
+  return this->remoteDeviceStruct;
+}
+
 // Getters for device information
 
 const unsigned char *RemoteDevice::getSensRes() const {
@@ -252,6 +265,64 @@ const unsigned char *RemoteDevice::getID() const {
   }
 }
 
+const unsigned char *RemoteDevice::getUID() const {
+  switch (remoteDeviceStruct.modeTech) {
+  case (tech.PASSIVE_NFCA):
+    return this->remoteDeviceStruct.info.nfcAPP.nfcId;
+    break;
+
+  case (tech.PASSIVE_NFCB):
+    // NFCID0 is the first field of SENSB_RES
+    return this->remoteDeviceStruct.info.nfcBPP.sensRes;
+    break;
+
+  case (tech.PASSIVE_NFCF):
+    // NFCID2 is the first field of SENSF_RES
+    return this->remoteDeviceStruct.info.nfcFPP.sensRes;
+    break;
+
+  case (tech.PASSIVE_NFCV):
+    return this->remoteDeviceStruct.info.nfcVPP.id;
+    break;
+
+  default:
+    return NULL;
+    break;
+  }
+}
+
+unsigned char RemoteDevice::getUIDLen() const {
+  switch (remoteDeviceStruct.modeTech) {
+  case (tech.PASSIVE_NFCA):
+    return this->remoteDeviceStruct.info.nfcAPP.nfcIdLen;
+    break;
+
+  case (tech.PASSIVE_NFCB):
+    return (this->remoteDeviceStruct.info.nfcBPP.sensResLen >= 4) ? 4 : 0;
+    break;
+
+  case (tech.PASSIVE_NFCF):
+    return (this->remoteDeviceStruct.info.nfcFPP.sensResLen >= 8) ? 8 : 0;
+    break;
+
+  case (tech.PASSIVE_NFCV):
+    return 8;
+    break;
+
+  default:
+    return 0;
+    break;
+  }
+}
+
+void RemoteDevice::setDiscoveryId(unsigned char discoveryId) {
+  this->remoteDeviceStruct.discoveryId = discoveryId;
+}
+
+void RemoteDevice::setMaxPayloadSize(unsigned char maxPayloadSize) {
+  this->remoteDeviceStruct.maxPayloadSize = maxPayloadSize;
+}
+
 void RemoteDevice::setInterface(unsigned char interface) {
   this->remoteDeviceStruct.interface = interface;
 }
@@ -356,3 +427,56 @@ void RemoteDevice::setInfo(RfIntf_t *pRfIntf, uint8_t *pBuf) {
     break;
   }
 }
+
+// RF_DISCOVER_NTF only carries the RF technology specific parameters, there
+// are no activation parameters (RATS, ATTRIB) to parse
+void RemoteDevice::setDiscoveryInfo(uint8_t *pBuf) {
+  uint8_t i, temp;
+
+  switch (remoteDeviceStruct.modeTech) {
+  case (tech.PASSIVE_NFCA):
+    memcpy(remoteDeviceStruct.info.nfcAPP.sensRes, &pBuf[0], 2);
+    remoteDeviceStruct.info.nfcAPP.sensResLen = 2;
+    temp = pBuf[2];
+    if (temp > sizeof(remoteDeviceStruct.info.nfcAPP.nfcId))
+      temp = sizeof(remoteDeviceStruct.info.nfcAPP.nfcId);
+    remoteDeviceStruct.info.nfcAPP.nfcIdLen = temp;
+    memcpy(remoteDeviceStruct.info.nfcAPP.nfcId, &pBuf[3], temp);
+    temp = 3 + pBuf[2];
+    remoteDeviceStruct.info.nfcAPP.selResLen = pBuf[temp];
+    if (remoteDeviceStruct.info.nfcAPP.selResLen == 1)
+      remoteDeviceStruct.info.nfcAPP.selRes[0] = pBuf[temp + 1];
+    remoteDeviceStruct.info.nfcAPP.ratsLen = 0;
+    break;
+
+  case (tech.PASSIVE_NFCB):
+    temp = pBuf[0];
+    if (temp > sizeof(remoteDeviceStruct.info.nfcBPP.sensRes))
+      temp = sizeof(remoteDeviceStruct.info.nfcBPP.sensRes);
+    remoteDeviceStruct.info.nfcBPP.sensResLen = temp;
+    memcpy(remoteDeviceStruct.info.nfcBPP.sensRes, &pBuf[1], temp);
+    remoteDeviceStruct.info.nfcBPP.attribResLen = 0;
+    break;
+
+  case (tech.PASSIVE_NFCF):
+    remoteDeviceStruct.info.nfcFPP.bitRate = pBuf[0];
+    temp = pBuf[1];
+    if (temp > sizeof(remoteDeviceStruct.info.nfcFPP.sensRes))
+      temp = sizeof(remoteDeviceStruct.info.nfcFPP.sensRes);
+    remoteDeviceStruct.info.nfcFPP.sensResLen = temp;
+    memcpy(remoteDeviceStruct.info.nfcFPP.sensRes, &pBuf[2], temp);
+    break;
+
+  case (tech.PASSIVE_NFCV):
+    remoteDeviceStruct.info.nfcVPP.afi = pBuf[0];
+    remoteDeviceStruct.info.nfcVPP.dsfid = pBuf[1];
+
+    for (i = 0; i < 8; i++) {
+      remoteDeviceStruct.info.nfcVPP.id[7 - i] = pBuf[2 + i];
+    }
+    break;
+
+  default:
+    break;
+  }
+}
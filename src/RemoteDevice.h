@@ -117,10 +117,12 @@ struct RfIntf_t {
 
 // Definition of discovered remote device properties using camelCase
 struct RfIntfCC_t {
+  unsigned char discoveryId;
   unsigned char interface;
   unsigned char protocol;
   unsigned char modeTech;
   bool moreTagsAvailable;
+  unsigned char maxPayloadSize;
   RfIntfInfoCC_t info;
 };
 
@@ -136,6 +138,10 @@ public:
   unsigned char getProtocol() const;
   unsigned char getModeTech() const;
   bool hasMoreTags() const;
+  unsigned char getDiscoveryId() const;
+  unsigned char getMaxPayloadSize() const;
+  // All the properties at once, read only
+  const RfIntfCC_t &getRfIntf() const;
   // Getters for device information properties
   const unsigned char *getSensRes() const;
   unsigned char getSensResLen() const;
@@ -151,12 +157,18 @@ public:
   unsigned char getAFI() const;
   unsigned char getDSFID() const;
   const unsigned char *getID() const;
+  // Technology independent identifier (NFCID1, NFCID0, NFCID2 or UID)
+  const unsigned char *getUID() const;
+  unsigned char getUIDLen() const;
   // Setters
   void setInterface(unsigned char interface);
   void setProtocol(unsigned char protocol);
   void setModeTech(unsigned char modeTech);
   void setMoreTagsAvailable(bool moreTags);
+  void setDiscoveryId(unsigned char discoveryId);
+  void setMaxPayloadSize(unsigned char maxPayloadSize);
   void setInfo(RfIntf_t *pRfIntf, uint8_t *pBuf);
+  void setDiscoveryInfo(uint8_t *pBuf);
 };
 
 #endif
@@ -0,0 +1,54 @@
+/**
+ * Library to queue the tag events produced by the continuous scan mode
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "TagEventQueue.h"
+
+TagEventQueue::TagEventQueue() { clear(); }
+
+/*
+ * The queue is bounded, when it is full the new event is dropped so the
+ * application still gets the oldest ones in order
+ */
+bool TagEventQueue::push(const TagEvent_t *event) {
+  if (count >= TAG_EVENT_QUEUE_SIZE) {
+    countDropped();
+    return false;
+  }
+
+  events[(head + count) % TAG_EVENT_QUEUE_SIZE] = *event;
+  count++;
+  return true;
+}
+
+bool TagEventQueue::pop(TagEvent_t *event) {
+  if (count == 0)
+    return false;
+
+  *event = events[head];
+  head = (head + 1) % TAG_EVENT_QUEUE_SIZE;
+  count--;
+  return true;
+}
+
+uint8_t TagEventQueue::getCount() const { return count; }
+
+uint16_t TagEventQueue::getDropped() const { return dropped; }
+
+void TagEventQueue::countDropped() {
+  if (dropped < 0xFFFF)
+    dropped++;
+}
+
+void TagEventQueue::clear() {
+  head = 0;
+  count = 0;
+  dropped = 0;
+}
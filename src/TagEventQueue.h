@@ -0,0 +1,56 @@
+/**
+ * Library to queue the tag events produced by the continuous scan mode
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef TagEventQueue_H
+#define TagEventQueue_H
+
+#include "Arduino.h"
+
+#ifndef TAG_EVENT_QUEUE_SIZE
+#define TAG_EVENT_QUEUE_SIZE 16
+#endif
+#define TAG_EVENT_MAX_UID_SIZE 10
+
+/*
+ * Kind of tag events
+ */
+#define TAG_EVENT_UID_SEEN 1  // Tag entered the field
+#define TAG_EVENT_ACTIVATED 2 // Tag activated, its RF interface is up
+#define TAG_EVENT_NDEF_READ 3 // NDEF read attempted, see ndefSize
+#define TAG_EVENT_REMOVED 4   // Tag not seen for the removal timeout
+
+typedef struct {
+  uint8_t type;
+  unsigned char uid[TAG_EVENT_MAX_UID_SIZE];
+  uint8_t uidLen;
+  uint8_t protocol;
+  unsigned short ndefSize; // Only for TAG_EVENT_NDEF_READ, 0 if none
+  unsigned long timestamp; // millis() when the event was queued
+} TagEvent_t;
+
+class TagEventQueue {
+private:
+  TagEvent_t events[TAG_EVENT_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t count;
+  uint16_t dropped;
+
+public:
+  TagEventQueue();
+  bool push(const TagEvent_t *event);
+  bool pop(TagEvent_t *event);
+  uint8_t getCount() const;
+  uint16_t getDropped() const;
+  void countDropped();
+  void clear();
+};
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * Library to remember the tags recently seen by the reader
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#include "UidCache.h"
+
+UidCache::UidCache() {
+  this->holdOff = 0;
+  clear();
+}
+
+void UidCache::setHoldOff(unsigned long holdOff) { this->holdOff = holdOff; }
+
+unsigned long UidCache::getHoldOff() const { return this->holdOff; }
+
+bool UidCache::isEnabled() const { return this->holdOff != 0; }
+
+UidCache::Entry *UidCache::find(const unsigned char *uid, uint8_t uidLen) {
+  if ((uidLen == 0) || (uidLen > UID_CACHE_MAX_UID_SIZE))
+    return NULL;
+
+  for (uint8_t i = 0; i < UID_CACHE_SIZE; i++) {
+    if ((entries[i].uidLen == uidLen) &&
+        (memcmp(entries[i].uid, uid, uidLen) == 0))
+      return &entries[i];
+  }
+  return NULL;
+}
+
+/*
+ * Returns true if the tag was already seen less than holdOff ms ago, the
+ * window restarts on every detection so a bouncing tag stays inside it.
+ * Unknown tags replace the least recently seen entry
+ */
+bool UidCache::seen(const unsigned char *uid, uint8_t uidLen,
+                    unsigned long now) {
+  Entry *entry = find(uid, uidLen);
+  bool repeated = false;
+
+  if ((uidLen == 0) || (uidLen > UID_CACHE_MAX_UID_SIZE))
+    return false;
+
+  if (entry != NULL) {
+    repeated = (now - entry->lastSeen) < holdOff;
+    if (!repeated)
+      entry->hasNdef = false;
+  } else {
+    entry = &entries[0];
+    for (uint8_t i = 0; i < UID_CACHE_SIZE; i++) {
+      if (entries[i].uidLen == 0) {
+        entry = &entries[i];
+        break;
+      }
+      if ((now - entries[i].lastSeen) > (now - entry->lastSeen))
+        entry = &entries[i];
+    }
+    memcpy(entry->uid, uid, uidLen);
+    entry->uidLen = uidLen;
+    entry->hasNdef = false;
+  }
+
+  entry->lastSeen = now;
+  return repeated;
+}
+
+/*
+ * The NDEF payload itself stays in the NDEF read buffer, so only the last
+ * read tag can have it cached
+ */
+void UidCache::setNdefCached(const unsigned char *uid, uint8_t uidLen) {
+  Entry *entry;
+
+  clearNdefCached();
+  entry = find(uid, uidLen);
+  if (entry != NULL)
+    entry->hasNdef = true;
+}
+
+bool UidCache::hasNdefCached(const unsigned char *uid, uint8_t uidLen) {
+  Entry *entry = find(uid, uidLen);
+
+  return (entry != NULL) && entry->hasNdef;
+}
+
+void UidCache::clearNdefCached() {
+  for (uint8_t i = 0; i < UID_CACHE_SIZE; i++)
+    entries[i].hasNdef = false;
+}
+
+void UidCache::clear() {
+  for (uint8_t i = 0; i < UID_CACHE_SIZE; i++) {
+    entries[i].uidLen = 0;
+    entries[i].lastSeen = 0;
+    entries[i].hasNdef = false;
+  }
+}
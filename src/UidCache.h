@@ -0,0 +1,52 @@
+/**
+ * Library to remember the tags recently seen by the reader
+ *
+ *  October 2026
+ *
+ * This code is beerware; if you see me (or any other collaborator
+ * member) at the local, and you've found our code helpful,
+ * please buy us a round!
+ * Distributed as-is; no warranty is given.
+ */
+
+#ifndef UidCache_H
+#define UidCache_H
+
+#include "Arduino.h"
+
+#ifndef UID_CACHE_SIZE
+#define UID_CACHE_SIZE 8
+#endif
+#define UID_CACHE_MAX_UID_SIZE 10
+
+/*
+ * What to do when a tag is detected again inside its hold-off window
+ */
+#define UID_CACHE_SHORT_CIRCUIT 0 // Report it, NDEF reads are served from cache
+#define UID_CACHE_SUPPRESS 1      // Do not report it at all
+
+class UidCache {
+private:
+  struct Entry {
+    unsigned char uid[UID_CACHE_MAX_UID_SIZE];
+    uint8_t uidLen;
+    unsigned long lastSeen;
+    bool hasNdef;
+  };
+  Entry entries[UID_CACHE_SIZE];
+  unsigned long holdOff;
+  Entry *find(const unsigned char *uid, uint8_t uidLen);
+
+public:
+  UidCache();
+  void setHoldOff(unsigned long holdOff);
+  unsigned long getHoldOff() const;
+  bool isEnabled() const;
+  bool seen(const unsigned char *uid, uint8_t uidLen, unsigned long now);
+  void setNdefCached(const unsigned char *uid, uint8_t uidLen);
+  bool hasNdefCached(const unsigned char *uid, uint8_t uidLen);
+  void clearNdefCached();
+  void clear();
+};
+
+#endif